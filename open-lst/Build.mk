@@ -14,7 +14,7 @@
 # You should have received a copy of the GNU General Public License
 # along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
-.PHONY: clean
+.PHONY: clean baud_table
 
 Q ?= @
 MODEL = medium
@@ -53,3 +53,8 @@ $(foreach radio,$(RADIOS),$(eval $(call RADIO_template,$(radio))))
 
 clean:
 	$(Q)rm -f $(ALL_OBJS)
+
+# Regenerate the UART baud rate table (checked in so the firmware
+# build doesn't need Python)
+baud_table:
+	$(Q)python $(ROOT_DIR)tools/gen_uart_baud_table.py -o $(COMMON_DIR)/uart_baud_table.h
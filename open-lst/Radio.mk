@@ -22,24 +22,38 @@ RADIO_SECTION_START = 0x0400
 # 0x6C00-0x6FFF is reserved for non-volatile storage
 # 0x6BE0-0x6BFF are reserved for the signature
 RADIO_SECTION_SIZE = 26592
+# XRAM for the linker, also passed to the code as XRAM_LOC/XRAM_SIZE
+RADIO_XRAM_LOC = 0xf000
+RADIO_XRAM_SIZE = 0x0d00
 
 RADIO_DIR := $(dir $(lastword $(MAKEFILE_LIST)))radio
 
 RADIO_ASFLAGS = -plogsgff
 RADIO_CFLAGS = --model-$(MODEL) -I$(COMMON_DIR) -I$(RADIO_DIR) \
-	-DGIT_REV=$(GIT_REV) -DGIT_REV_HEX=$(GIT_REV_HEX)
+	-DGIT_REV=$(GIT_REV) -DGIT_REV_HEX=$(GIT_REV_HEX) \
+	-DXRAM_LOC=$(RADIO_XRAM_LOC) -DXRAM_SIZE=$(RADIO_XRAM_SIZE)
 RADIO_LDFLAGS = --model-$(MODEL) --out-fmt-ihx \
-	--xram-loc 0xf000 --xram-size 0x0d00 --iram-size 0x100 \
+	--xram-loc $(RADIO_XRAM_LOC) --xram-size $(RADIO_XRAM_SIZE) --iram-size 0x100 \
 	--code-loc $(RADIO_SECTION_START) \
 	--code-size $(RADIO_SECTION_SIZE) \
 	-Wl-bFLASHTRIGSEG=0x0520
 
 RADIO_SRCS = $(RADIO_DIR)/main.c \
 	$(RADIO_DIR)/adc.c \
+	$(RADIO_DIR)/auth.c \
+	$(RADIO_DIR)/beacon.c \
 	$(RADIO_DIR)/commands.c \
+	$(RADIO_DIR)/compress.c \
+	$(RADIO_DIR)/fec.c \
+	$(RADIO_DIR)/memwatch.c \
+	$(RADIO_DIR)/profile.c \
+	$(RADIO_DIR)/reply_cache.c \
 	$(RADIO_DIR)/schedule.c \
+	$(RADIO_DIR)/telem_history.c \
+	$(RADIO_DIR)/telem_sel.c \
 	$(RADIO_DIR)/telemetry.c \
-	$(RADIO_DIR)/timers.c
+	$(RADIO_DIR)/timers.c \
+	$(RADIO_DIR)/timetag.c
 
 #flash_trigger must come first (code alignment)
 RADIO_ASMS = $(RADIO_DIR)/flash_trigger.asm
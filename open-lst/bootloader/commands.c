@@ -35,8 +35,6 @@ uint8_t commands_handle_command(const __xdata command_t *cmd, uint8_t len, __xda
 	__xdata msg_data_t *reply_data;
 	__bit reset_timeout = 0;
 
-	len;  // To avoid compiler warnings about this being unused
-
 	cmd_data = (__xdata msg_data_t *) cmd->data;
 	reply_data = (__xdata msg_data_t *) reply->data;
 
@@ -78,11 +76,15 @@ uint8_t commands_handle_command(const __xdata command_t *cmd, uint8_t len, __xda
 		case bootloader_msg_write_page:
 			WATCHDOG_CLEAR;
 			reset_timeout = 1;
+			// Don't write a partial page
+			if (len < sizeof(cmd->header) + sizeof(cmd_data->write_page)) {
+				reply->header.command = bootloader_msg_nack;
+				break;
+			}
 			flash_err = flash_write_app_page(cmd_data->write_page.flash_page, cmd_data->write_page.page_data);
 			if (flash_err != FLASH_WRITE_OK) {
 				reply->header.command = bootloader_msg_nack;
 			} else {
-				// TODO check length
 				if (cmd_data->write_page.flash_page == 255 && signature_app_valid()) { // TODO constant
 					timeout = 1000;  // TODO constant
 				}
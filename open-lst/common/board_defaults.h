@@ -17,8 +17,7 @@
 #ifndef _BOARD_DEFAULTS_H
 #define _BOARD_DEFAULTS_H
 
-//TODO: remove?
-#include "radio.h"
+#include <stdint.h>
 
 #ifdef CUSTOM_BOARD_INIT
 #include "board.h"
@@ -57,6 +56,25 @@
 #define UART1_ENABLED 1
 #endif
 
+// Baud rates can be given directly (for example
+// #define CONFIG_UART1_BAUD_RATE 921600) and are looked up for
+// F_CLK in uart_baud_table.h
+#include "uart_baud_table.h"
+#ifdef CONFIG_UART0_BAUD_RATE
+#if !UART_BAUD_OK(CONFIG_UART0_BAUD_RATE)
+#error "CONFIG_UART0_BAUD_RATE is not in uart_baud_table.h for this F_CLK"
+#endif
+#define CONFIG_UART0_BAUD UART_BAUD_M(CONFIG_UART0_BAUD_RATE)
+#define CONFIG_UART0_GCR  UART_BAUD_E(CONFIG_UART0_BAUD_RATE)
+#endif
+#ifdef CONFIG_UART1_BAUD_RATE
+#if !UART_BAUD_OK(CONFIG_UART1_BAUD_RATE)
+#error "CONFIG_UART1_BAUD_RATE is not in uart_baud_table.h for this F_CLK"
+#endif
+#define CONFIG_UART1_BAUD UART_BAUD_M(CONFIG_UART1_BAUD_RATE)
+#define CONFIG_UART1_GCR  UART_BAUD_E(CONFIG_UART1_BAUD_RATE)
+#endif
+
 // Default baud rates are 115200
 #ifndef CONFIG_UART0_BAUD
 #define CONFIG_UART0_BAUD 24
@@ -72,12 +90,57 @@
 #define CONFIG_UART1_GCR 12
 #endif
 
+// RTS flow control (an output) tells the host to pause while the
+// receive buffers are nearly full. RTS_WAIT is asserted once only
+// CONFIG_UARTn_RTS_RESERVE free buffers are left, which gives the
+// host time to react while a frame is already in flight.
+#ifndef CONFIG_UART0_USE_FLOW_CTRL
+#define CONFIG_UART0_USE_FLOW_CTRL 0
+#endif
+#ifndef CONFIG_UART0_FLOW_PIN
+#define CONFIG_UART0_FLOW_PIN P1_3
+#endif
+#ifndef CONFIG_UART0_RTS_RESERVE
+#define CONFIG_UART0_RTS_RESERVE 0
+#endif
 #ifndef CONFIG_UART1_USE_FLOW_CTRL
 #define CONFIG_UART1_USE_FLOW_CTRL 1
 #endif
 #ifndef CONFIG_UART1_FLOW_PIN
 #define CONFIG_UART1_FLOW_PIN P0_3
 #endif
+#ifndef CONFIG_UART1_RTS_RESERVE
+#define CONFIG_UART1_RTS_RESERVE 1
+#endif
+// CTS flow control (an input) holds off transmission while the
+// host isn't ready. This is off by default because an unconnected
+// CTS pin would stop the UART from ever sending.
+#ifndef CONFIG_UART0_USE_CTS
+#define CONFIG_UART0_USE_CTS 0
+#endif
+#ifndef CONFIG_UART0_CTS_PIN
+#define CONFIG_UART0_CTS_PIN P1_2
+#endif
+#ifndef CONFIG_UART1_USE_CTS
+#define CONFIG_UART1_USE_CTS 0
+#endif
+#ifndef CONFIG_UART1_CTS_PIN
+#define CONFIG_UART1_CTS_PIN P0_2
+#endif
+// Accept ESP v2 frames (0x22 0x6B) on both UARTs. These carry a
+// CRC and can batch several messages. A UART replies with v2
+// frames once the host has sent it one, so v1 hosts are unaffected.
+// The bootloader only speaks v1.
+#ifndef CONFIG_UART_ESP2
+#define CONFIG_UART_ESP2 0
+#endif
+// Receive UART1 payloads with DMA (channel 4) so the RX ISR only
+// runs for the three header bytes of each frame. The DMA ISR that
+// ends each payload is raised to UART1's priority along with the RF
+// ISR, which is in the same priority group.
+#ifndef CONFIG_UART1_RX_DMA
+#define CONFIG_UART1_RX_DMA 0
+#endif
 
 // Defaults: flush active transaction, no flow control,
 // 8 bits, no parity, 1 high stop bit, 1 low start bit
@@ -181,6 +244,17 @@
 #ifndef ADCCFG_CONFIG
 #define ADCCFG_CONFIG 0b00000000
 #endif
+// Report each ADC channel as the mean of 2^ADC_OVERSAMPLE_SHIFT sweeps
+// (one per 10Hz tick, at most 16), with the min and max over the same
+// sweeps. ADC_EXTRA_BITS of the mean's extra resolution are kept, which
+// scales all three by 2^ADC_EXTRA_BITS. Each extra bit takes four times
+// the sweeps, so ADC_EXTRA_BITS can be at most ADC_OVERSAMPLE_SHIFT / 2.
+#ifndef ADC_OVERSAMPLE_SHIFT
+#define ADC_OVERSAMPLE_SHIFT 0
+#endif
+#ifndef ADC_EXTRA_BITS
+#define ADC_EXTRA_BITS 0
+#endif
 
 // This is the default delay (in main loop counts)
 // before trying to boot the application image
@@ -293,6 +367,197 @@
 #define RF_PA_CONFIG     192
 #endif
 
+// Reed-Solomon outer code for RF frames. When enabled, parity is
+// appended after the CRC and frames that fail their CRC are corrected
+// (up to RF_RS_PARITY_BYTES / 2 damaged bytes) before being rejected.
+// Both ends of the link must use the same settings. The parity count
+// must be even and at most 32.
+#ifndef RF_RS_ENABLED
+#define RF_RS_ENABLED 0
+#endif
+#ifndef RF_RS_PARITY_BYTES
+#define RF_RS_PARITY_BYTES 16
+#endif
+
+// Compress payload messages (any system other than MSG_TYPE_RADIO_IN)
+// forwarded from UART1 to RF when that makes them smaller. The
+// receiving radio forwards them to its UART1 still compressed and
+// radio_mux expands them.
+#ifndef RF_COMPRESSION_ENABLED
+#define RF_COMPRESSION_ENABLED 0
+#endif
+
+// Accept radio_msg_secure commands (AES-CCM with a replay counter)
+// and require them for reboot, set_time and set_callsign. The key is
+// loaded into flash storage by flash_bootloader --auth-key.
+#ifndef AUTH_ENABLED
+#define AUTH_ENABLED 0
+#endif
+
+// Keep the replies to the last few RF commands so a command resent
+// with the same seqnum (because its reply was lost) is answered again
+// without running twice. Replies longer than REPLY_CACHE_MAX_REPLY
+// bytes aren't kept; the default fits an ack wrapped by AUTH_ENABLED.
+// Entries are dropped after REPLY_CACHE_TTL seconds. 0 entries
+// disables the cache.
+#ifndef REPLY_CACHE_ENTRIES
+#define REPLY_CACHE_ENTRIES 0
+#endif
+#ifndef REPLY_CACHE_MAX_REPLY
+#define REPLY_CACHE_MAX_REPLY 20
+#endif
+#ifndef REPLY_CACHE_TTL
+#define REPLY_CACHE_TTL 30
+#endif
+
+// Idle the CPU (PM0) in the main loop while no interrupt has left
+// any work for it
+#ifndef MAIN_LOOP_IDLE
+#define MAIN_LOOP_IDLE 1
+#endif
+
+// Main loop scheduling. Of the sources with work pending, the one
+// with the lowest priority number runs next, handling one message (or
+// tick) per call, and each may be called up to its budget per pass
+// before the lower priority sources get their turn. RF comes first so
+// command replies aren't held up behind forwarded UART traffic.
+#ifndef MAIN_LOOP_PRIORITY_RF
+#define MAIN_LOOP_PRIORITY_RF 0
+#endif
+#ifndef MAIN_LOOP_PRIORITY_TICK
+#define MAIN_LOOP_PRIORITY_TICK 1
+#endif
+#ifndef MAIN_LOOP_PRIORITY_UART0
+#define MAIN_LOOP_PRIORITY_UART0 2
+#endif
+#ifndef MAIN_LOOP_PRIORITY_UART1
+#define MAIN_LOOP_PRIORITY_UART1 3
+#endif
+#ifndef MAIN_LOOP_BUDGET_RF
+#define MAIN_LOOP_BUDGET_RF 1
+#endif
+#ifndef MAIN_LOOP_BUDGET_TICK
+#define MAIN_LOOP_BUDGET_TICK 1
+#endif
+#ifndef MAIN_LOOP_BUDGET_UART0
+#define MAIN_LOOP_BUDGET_UART0 2
+#endif
+#ifndef MAIN_LOOP_BUDGET_UART1
+#define MAIN_LOOP_BUDGET_UART1 2
+#endif
+
+// Size of the pool of scheduled timers (see schedule.h). The 10Hz
+// housekeeping loop uses one.
+#ifndef SCHEDULE_TIMERS
+#define SCHEDULE_TIMERS 8
+#endif
+// Run Timer 1 free instead of interrupting every millisecond. The ISR
+// then only counts overflows (about every 2.4ms) and wakes the
+// scheduler with one-shot compares. Ranging keeps its capture, but
+// RF_PRECISE_TIMING_DELAY counts overflows rather than milliseconds.
+#ifndef TIMERS_TICKLESS
+#define TIMERS_TICKLESS 0
+#endif
+
+// Measurement hooks around the 1ms Timer 1 tick ISR and around each
+// timer callback, for example to toggle a pin for a scope
+#ifndef SCHEDULE_ISR_HOOK_ENTER
+#define SCHEDULE_ISR_HOOK_ENTER
+#endif
+#ifndef SCHEDULE_ISR_HOOK_EXIT
+#define SCHEDULE_ISR_HOOK_EXIT
+#endif
+#ifndef SCHEDULE_DISPATCH_HOOK_ENTER
+#define SCHEDULE_DISPATCH_HOOK_ENTER
+#endif
+#ifndef SCHEDULE_DISPATCH_HOOK_EXIT
+#define SCHEDULE_DISPATCH_HOOK_EXIT
+#endif
+
+// Time each main loop handler with Timer 1 and report the figures
+// with get_profile
+#ifndef PROFILE_ENABLED
+#define PROFILE_ENABLED 0
+#endif
+
+// Also keep the longest run and a histogram of run times for each ISR
+// (see profile_isr.h), added to the get_profile reply. This costs a
+// few microseconds in every ISR.
+#ifndef PROFILE_ISR_ENABLED
+#define PROFILE_ISR_ENABLED 0
+#endif
+#if PROFILE_ISR_ENABLED == 1 && PROFILE_ENABLED != 1
+#error "PROFILE_ISR_ENABLED needs PROFILE_ENABLED"
+#endif
+
+// Paint unused IRAM stack and XRAM at boot and report in the
+// stack_free and xram_free telemetry how much of each has never been
+// touched
+#ifndef MEMWATCH_ENABLED
+#define MEMWATCH_ENABLED 0
+#endif
+
+// Queue up to TIMETAG_ENTRIES commands (each up to TIMETAG_MAX_COMMAND
+// bytes of opcode and data) with timetag_add to run when the RTC
+// reaches a given time. The queue is in XRAM and doesn't survive a
+// reboot. 0 entries disables it.
+#ifndef TIMETAG_ENTRIES
+#define TIMETAG_ENTRIES 0
+#endif
+#ifndef TIMETAG_MAX_COMMAND
+#define TIMETAG_MAX_COMMAND 16
+#endif
+
+// update_telemetry fills a second copy of the telemetry and swaps it
+// in, so a reply never mixes two updates. 1 saves sizeof(telemetry_t)
+// bytes of XRAM, for boards that don't read the telemetry from
+// anywhere update_telemetry can cut into.
+#ifndef TELEMETRY_BUFFERS
+#define TELEMETRY_BUFFERS 2
+#endif
+
+// Keep a snapshot of the housekeeping telemetry every
+// TELEM_HISTORY_PERIOD seconds, in a ring of TELEM_HISTORY_ENTRIES
+// records (31 bytes of XRAM each) read back with get_telem_history.
+// 0 entries disables the history.
+#ifndef TELEM_HISTORY_ENTRIES
+#define TELEM_HISTORY_ENTRIES 0
+#endif
+#ifndef TELEM_HISTORY_PERIOD
+#define TELEM_HISTORY_PERIOD 60
+#endif
+
+// Let get_telem_sel send only the fields that changed since the last
+// reply the ground acknowledged. This keeps a copy of the telemetry
+// in XRAM.
+#ifndef TELEM_DELTA_ENABLED
+#define TELEM_DELTA_ENABLED 0
+#endif
+
+// Send a telemetry beacon every BEACON_INTERVAL seconds (0 for none
+// until set_beacon turns it on), plus up to BEACON_JITTER_MS. RF
+// beacons are left out when they would take more than
+// BEACON_MAX_DUTY_PERCENT of the airtime, reckoned at
+// BEACON_MS_PER_BYTE (about right for the 7k FEC mode).
+#ifndef BEACON_ENABLED
+#define BEACON_ENABLED 0
+#endif
+#ifndef BEACON_INTERVAL
+#define BEACON_INTERVAL 0
+#endif
+#ifndef BEACON_JITTER_MS
+#define BEACON_JITTER_MS 1000
+#endif
+#ifndef BEACON_OUTPUTS
+#define BEACON_OUTPUTS BEACON_OUTPUT_RF
+#endif
+#ifndef BEACON_MAX_DUTY_PERCENT
+#define BEACON_MAX_DUTY_PERCENT 10
+#endif
+#ifndef BEACON_MS_PER_BYTE
+#define BEACON_MS_PER_BYTE 3
+#endif
+
 #ifndef MAX_RX_TICKS
 // Default of 5 seconds
 #define MAX_RX_TICKS 50
@@ -309,4 +574,8 @@ typedef enum {
 void board_defaults_init(void);
 uint8_t board_apply_radio_settings(uint8_t mode);
 
+//TODO: remove?
+// After the defaults, which radio.h's ISR prototype depends on
+#include "radio.h"
+
 #endif
@@ -68,6 +68,9 @@
 #define SLEEP_OSC_MODE_PM2   (2<<0)
 #define SLEEP_OSC_MODE_PM3   (3<<0)
 
+// PCON - Power Mode Control
+#define PCON_IDLE            (1<<0)
+
 
 // IP0 - Interrupt Priorities
 #define IP0_IPG5             (1<<5)
@@ -465,6 +468,13 @@
 #define RFIF_IM_CCA       (1<<1)
 #define RFIF_IM_SFD       (1<<0)
 
+// PKTSTATUS - Packet Status
+#define PKTSTATUS_CRC_OK  (1<<7)
+#define PKTSTATUS_CS      (1<<6)
+#define PKTSTATUS_PQT     (1<<5)
+#define PKTSTATUS_CCA     (1<<4)
+#define PKTSTATUS_SFD     (1<<3)
+
 // DMA Controller Configuration Structure
 typedef struct {
 	uint8_t src_h;     // High bits of the source address
@@ -47,6 +47,42 @@ typedef union command_buffer {
  	command_t cmd;
 } command_buffer_t;
 
+// Longest payload after the header
+#define COMMAND_MAX_DATA (ESP_MAX_PAYLOAD - sizeof(command_header_t))
+
+// Arguments for the handlers in the application's command table.
+// SDCC only passes the first argument of a function called through
+// a pointer in registers unless it's reentrant, so these are bundled
+// together.
+typedef struct {
+	const __xdata command_t *cmd;
+	__xdata command_t *reply;
+	uint8_t len;  // Payload length (after the header)
+} command_args_t;
+
+// A handler sets the reply opcode (the default is a nack) and returns
+// the reply payload length, or COMMAND_NO_REPLY to send nothing
+typedef uint8_t (*command_handler_t)(__xdata command_args_t *args);
+
+#define COMMAND_NO_REPLY 0xff
+
+typedef struct {
+	command_handler_t handler;
+	uint8_t min_len;  // Payload length limits checked before the handler runs
+	uint8_t max_len;
+	uint8_t max_reply;  // Longest reply payload, to fit it into a batch
+	uint8_t flags;
+} command_entry_t;
+
+#define COMMAND_FLAG_AUTH (1<<0)  /** Only accepted inside radio_msg_secure */
+#define COMMAND_FLAG_NO_BATCH (1<<1)  /** Not accepted inside radio_msg_batch or timetag_add */
+
 uint8_t commands_handle_command(const __xdata command_t *cmd, uint8_t len, __xdata command_t *reply);
+#ifndef BOOTLOADER
+// Handle a command that was accepted earlier (and authenticated then
+// if it was wrapped) and is only being run now
+uint8_t commands_handle_deferred(__xdata command_t *cmd, uint8_t len,
+                                 __xdata command_t *reply, uint8_t was_authenticated);
+#endif
 
 #endif
\ No newline at end of file
@@ -20,4 +20,9 @@
 
 uint16_t crc16(__xdata uint8_t *data, uint16_t len);
 
+// For checksums built up a byte at a time (same CRC as crc16)
+#define crc16_start() do { RNDL = 0xFF; RNDL = 0xFF; } while (0)
+#define crc16_add(c) RNDH = (c)
+#define crc16_result() (RNDH << 8 | RNDL)
+
 #endif
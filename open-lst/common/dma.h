@@ -21,9 +21,13 @@
 
 typedef enum {
 	dma_channel_flash_write = 0,
+	// Only the bootloader writes flash, so the application's ADC
+	// sweep can use the same channel
+	dma_channel_adc = 0,
 	dma_channel_rf = 1,
 	dma_channel_aes_in = 2,
-	dma_channel_aes_out = 3
+	dma_channel_aes_out = 3,
+	dma_channel_uart1_rx = 4
 } dma_channel_t;
 
 
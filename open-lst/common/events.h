@@ -0,0 +1,48 @@
+// OpenLST
+// Copyright (C) 2018 Planet Labs Inc.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// Wakeup events for the application main loop
+#ifndef _EVENTS_H
+#define _EVENTS_H
+
+#include <stdint.h>
+
+#define EVENT_TICK  (1<<0)  // 10Hz schedule tick
+#define EVENT_UART0 (1<<1)  // UART0 message ready
+#define EVENT_UART1 (1<<2)  // UART1 message ready
+#define EVENT_RF    (1<<3)  // RF packet received
+#define EVENT_ALL   (EVENT_TICK | EVENT_UART0 | EVENT_UART1 | EVENT_RF)
+
+#ifdef BOOTLOADER
+// The bootloader polls
+#define EVENT_SET(e)
+#define TELEMETRY_SEQ_BUMP
+#else
+extern volatile __data uint8_t main_events;
+// Per source, in PROFILE_* order
+#define MAIN_LOOP_SOURCES 4
+extern __xdata uint32_t main_loop_starved[MAIN_LOOP_SOURCES];
+// This is a single orl so it's safe from ISRs and the main loop
+#define EVENT_SET(e) main_events |= (e)
+// ISRs bump this after changing anything update_telemetry reads, which
+// then retries a copy that an ISR cut into. A single inc, so safe from
+// any ISR.
+extern volatile __data uint8_t telemetry_seq;
+#define TELEMETRY_SEQ_BUMP telemetry_seq++;
+#endif
+
+#endif
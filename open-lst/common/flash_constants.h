@@ -41,6 +41,8 @@
 #define FLASH_APP_CRC        0x6BFE
 #define FLASH_STORAGE_START  0x6C00
 #define FLASH_STORAGE_END    0x6FFF
+// Command authentication key (last 16 bytes of storage)
+#define FLASH_AUTH_KEY       0x6FF0
 #define FLASH_UPDATER_START  0x7000
 #define FLASH_SIZE           0x8000
 
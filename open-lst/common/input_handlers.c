@@ -26,9 +26,27 @@
 #include "uart0.h"
 #include "uart1.h"
 #include "radio.h"
+#include "stringx.h"
+#if REPLY_CACHE_ENTRIES > 0 && !defined(BOOTLOADER)
+#include "reply_cache.h"
+#endif
+#if BEACON_ENABLED == 1 && !defined(BOOTLOADER)
+#include "beacon.h"
+#endif
+
+#if RF_COMPRESSION_ENABLED == 1 && !defined(BOOTLOADER)
+#include "compress.h"
+
+// HWID, seqnum and system are left uncompressed so the frame can
+// still be routed
+#define COMPRESSED_HEADER_SIZE (sizeof(command_header_t) - sizeof(radio_msg_no_t))
+#endif
 
 static __xdata command_buffer_t buffer;
 static __xdata command_buffer_t reply;
+#if TIMETAG_ENTRIES > 0 && !defined(BOOTLOADER)
+__xdata uint8_t input_source;
+#endif
 
 // TODO: good idea?
 // Overridable in case zero-length messages,
@@ -46,7 +64,9 @@ static __xdata command_buffer_t reply;
 void input_handle_uart0_rx(void) {
 	uint8_t len;
 	uint8_t reply_len;
-	len = uart0_get_message(buffer.msg);
+	__xdata command_buffer_t *msg;
+	// The message is handled in place in the UART buffer
+	len = uart0_lease_message(&msg);
 	if (len == 0) { // no messages
 		return;
 	}
@@ -55,23 +75,23 @@ void input_handle_uart0_rx(void) {
 	// is a full message, and is targeted at the radio
 	if (len < MIN_UART_MSG_SIZE) {
 		// Just ignore the message if it is too small
-	} else if (buffer.cmd.header.system == MSG_TYPE_RADIO_IN &&
-	           (buffer.cmd.header.hwid == hwid_flash ||
-	            buffer.cmd.header.hwid == HWID_LOCAL)) {
+	} else if (msg->cmd.header.system == MSG_TYPE_RADIO_IN &&
+	           (msg->cmd.header.hwid == hwid_flash ||
+	            msg->cmd.header.hwid == HWID_LOCAL)) {
 		// If it is for us, pass the message off to the command handler
-		reply_len = commands_handle_command(&buffer.cmd, len, &reply.cmd);
+		INPUT_SET_SOURCE(INPUT_SOURCE_UART0)
+		reply_len = commands_handle_command(&msg->cmd, len, &reply.cmd);
 		if (reply_len) {
 			uart0_send_message(reply.msg, reply_len);
 		}
-		return;
 	} else {
 		#if FORWARD_MESSAGES_UART0 == 1
 		// If it's addressed elsewhere, attempt to forward it out
 		// over the RF link
-		radio_send_packet(&buffer.cmd, len, RF_TIMING_NOW, 0);
+		radio_send_packet(&msg->cmd, len, RF_TIMING_NOW, FLAGS_UART0_SEL);
 		#endif
 	}
-	return;
+	uart0_release_message();
 }
 #endif
 
@@ -79,7 +99,9 @@ void input_handle_uart0_rx(void) {
 void input_handle_uart1_rx(void) {
 	uint8_t len;
 	uint8_t reply_len;
-	len = uart1_get_message(buffer.msg);
+	__xdata command_buffer_t *msg;
+	// The message is handled in place in the UART buffer
+	len = uart1_lease_message(&msg);
 	if (len == 0) { // no messages
 		return;
 	}
@@ -88,31 +110,49 @@ void input_handle_uart1_rx(void) {
 	// is a full message, and is targeted at the radio
 	if (len < MIN_UART_MSG_SIZE) {
 		// Just ignore the message if it is too small
-	} else if (buffer.cmd.header.system == MSG_TYPE_RADIO_IN &&
-	           (buffer.cmd.header.hwid == hwid_flash ||
-	            buffer.cmd.header.hwid == HWID_LOCAL)) {
+	} else if (msg->cmd.header.system == MSG_TYPE_RADIO_IN &&
+	           (msg->cmd.header.hwid == hwid_flash ||
+	            msg->cmd.header.hwid == HWID_LOCAL)) {
 		// If it is for us, pass the message off to the command handler
-		reply_len = commands_handle_command(&buffer.cmd, len, &reply.cmd);
+		INPUT_SET_SOURCE(INPUT_SOURCE_UART1)
+		reply_len = commands_handle_command(&msg->cmd, len, &reply.cmd);
 		if (reply_len) {
 			uart1_send_message(reply.msg, reply_len);
 		}
-		return;
 	} else {
 		#if FORWARD_MESSAGES_UART1 == 1
+		#if RF_COMPRESSION_ENABLED == 1 && !defined(BOOTLOADER)
+		// Payload traffic is compressed into the reply buffer (which
+		// is free while forwarding) if that makes it any smaller
+		if (msg->cmd.header.system != MSG_TYPE_RADIO_IN) {
+			reply_len = compress_message(
+				&msg->msg[COMPRESSED_HEADER_SIZE],
+				len - COMPRESSED_HEADER_SIZE,
+				&reply.msg[COMPRESSED_HEADER_SIZE],
+				len - COMPRESSED_HEADER_SIZE - 1);
+			if (reply_len) {
+				memcpyx(reply.msg, msg->msg, COMPRESSED_HEADER_SIZE);
+				radio_send_packet(&reply.cmd, reply_len + COMPRESSED_HEADER_SIZE,
+				                  RF_TIMING_NOW, FLAGS_UART1_SEL | FLAGS_COMPRESSED);
+				uart1_release_message();
+				return;
+			}
+		}
+		#endif
 		// If it's addressed elsewhere, attempt to forward it out
 		// over the RF link
-		radio_send_packet(&buffer.cmd, len, RF_TIMING_NOW, 1);
+		radio_send_packet(&msg->cmd, len, RF_TIMING_NOW, FLAGS_UART1_SEL);
 		#endif
 	}
-	return;
+	uart1_release_message();
 }
 #endif
 
 void input_handle_rf_rx(void) {
 	uint8_t len;
 	uint8_t reply_len;
-	uint8_t uart_sel;
-	len = radio_get_message(&buffer.cmd, &uart_sel);
+	uint8_t flags;
+	len = radio_get_message(&buffer.cmd, &flags);
 	if (len == 0) { // no messages
 		return;
 	}
@@ -124,19 +164,95 @@ void input_handle_rf_rx(void) {
 		buffer.cmd.header.system == MSG_TYPE_RADIO_IN &&
 		(buffer.cmd.header.hwid == hwid_flash ||
 		 buffer.cmd.header.hwid == HWID_LOCAL)) {
+		// Commands are never compressed, drop anything that claims
+		// to be
+		if (flags & FLAGS_COMPRESSED) {
+			return;
+		}
+		INPUT_SET_SOURCE(INPUT_SOURCE_RF | (flags & FLAGS_UART_SEL))
+		#if REPLY_CACHE_ENTRIES > 0 && !defined(BOOTLOADER)
+		// Resent commands get the reply that was lost instead of
+		// running again
+		reply_len = reply_cache_lookup(&buffer.cmd, len, &reply.cmd);
+		if (!reply_len) {
+			reply_len = commands_handle_command(&buffer.cmd, len, &reply.cmd);
+			reply_cache_store(&reply.cmd, reply_len);
+		}
+		#else
 		// If it is, pass the message off to the command handler
 		reply_len = commands_handle_command(&buffer.cmd, len, &reply.cmd);
+		#endif
 		if (reply_len) {
-			radio_send_packet(&reply.cmd, reply_len, RF_TIMING_NOW, uart_sel);
+			radio_send_packet(&reply.cmd, reply_len, RF_TIMING_NOW,
+			                  flags & FLAGS_UART_SEL);
 		}
 		return;
 	} else {
 		// If it's addressed elsewhere, attempt to forward it out
-		// over the serial link
+		// over the serial link. Compressed messages are passed
+		// on as-is with a different start byte.
 		// TODO: respect the UART selection in flags
 		#if FORWARD_MESSAGES_RF == 1
-		uart1_send_message(buffer.msg, len);
+		uart1_send_frame((flags & FLAGS_COMPRESSED) ? ESP_START_BYTE_1_LZ : ESP_START_BYTE_1,
+		                 buffer.msg, len);
 		#endif
 	}
 	return;
-}
\ No newline at end of file
+}
+
+#if TIMETAG_ENTRIES > 0 && !defined(BOOTLOADER)
+void input_dispatch_command(uint8_t source, uint16_t seqnum,
+                            uint8_t authenticated,
+                            const __xdata uint8_t *cmd, uint8_t len) {
+	uint8_t reply_len;
+
+	// The RF buffer is free outside input_handle_rf_rx
+	buffer.cmd.header.hwid = hwid_flash;
+	buffer.cmd.header.seqnum = seqnum;
+	buffer.cmd.header.system = MSG_TYPE_RADIO_IN;
+	memcpyx((__xdata void *) &buffer.cmd.header.command, (__xdata void *) cmd, len);
+	len += sizeof(buffer.cmd.header) - sizeof(radio_msg_no_t);
+
+	input_source = source;
+	reply_len = commands_handle_deferred(&buffer.cmd, len, &reply.cmd, authenticated);
+	if (!reply_len) {
+		return;
+	}
+	if (source & INPUT_SOURCE_RF) {
+		radio_send_packet(&reply.cmd, reply_len, RF_TIMING_NOW,
+		                  source & FLAGS_UART_SEL);
+	}
+	#if UART0_ENABLED == 1
+	else if (source == INPUT_SOURCE_UART0) {
+		uart0_send_message(reply.msg, reply_len);
+	}
+	#endif
+	#if UART1_ENABLED == 1
+	else if (source == INPUT_SOURCE_UART1) {
+		uart1_send_message(reply.msg, reply_len);
+	}
+	#endif
+}
+#endif
+
+#if BEACON_ENABLED == 1 && !defined(BOOTLOADER)
+__xdata command_t *input_beacon_buffer(void) {
+	return &reply.cmd;
+}
+
+void input_send_beacon(uint8_t outputs, uint8_t len) {
+	if (outputs & BEACON_OUTPUT_RF) {
+		radio_send_packet(&reply.cmd, len, RF_TIMING_NOW, 0);
+	}
+	#if UART0_ENABLED == 1
+	if (outputs & BEACON_OUTPUT_UART0) {
+		uart0_send_message(reply.msg, len);
+	}
+	#endif
+	#if UART1_ENABLED == 1
+	if (outputs & BEACON_OUTPUT_UART1) {
+		uart1_send_message(reply.msg, len);
+	}
+	#endif
+}
+#endif
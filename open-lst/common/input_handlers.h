@@ -17,6 +17,8 @@
 #ifndef _INPUT_HANDLERS_H
 #define _INPUT_HANDLERS_H
 
+#include "commands.h"
+
 #if UART0_ENABLED == 1
 void input_handle_uart0_rx(void);
 #endif
@@ -25,4 +27,32 @@ void input_handle_uart1_rx(void);
 #endif
 void input_handle_rf_rx(void);
 
+#if TIMETAG_ENTRIES > 0 && !defined(BOOTLOADER)
+// Where the command being handled came from, so the reply to a
+// deferred command can go back the same way. RF commands keep the
+// FLAGS_UART_SEL bit of their packet.
+#define INPUT_SOURCE_UART0 0
+#define INPUT_SOURCE_UART1 1
+#define INPUT_SOURCE_RF    2
+extern __xdata uint8_t input_source;
+
+// Run a command (opcode and data) that was held back, and send the
+// reply to source
+void input_dispatch_command(uint8_t source, uint16_t seqnum,
+                            uint8_t authenticated,
+                            const __xdata uint8_t *cmd, uint8_t len);
+#define INPUT_SET_SOURCE(source) input_source = (source);
+#else
+#define INPUT_SET_SOURCE(source)
+#endif
+
+#if BEACON_ENABLED == 1 && !defined(BOOTLOADER)
+// Unsolicited frames are built in the reply buffer, which is free
+// outside the handlers above
+__xdata command_t *input_beacon_buffer(void);
+// Send the frame in the reply buffer to each of outputs
+// (BEACON_OUTPUT_*)
+void input_send_beacon(uint8_t outputs, uint8_t len);
+#endif
+
 #endif
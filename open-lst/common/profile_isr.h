@@ -0,0 +1,98 @@
+// OpenLST
+// Copyright (C) 2018 Planet Labs Inc.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef _PROFILE_ISR_H
+#define _PROFILE_ISR_H
+
+#include <stdint.h>
+#include "board_defaults.h"
+
+// Time spent in each ISR, from Timer 1, which counts F_CLK cycles and
+// wraps every millisecond. count[0] is the number of runs that took
+// fewer than 1 << PROFILE_ISR_BUCKET0_SHIFT cycles, each bucket after
+// that covers twice the range of the one before and the last takes
+// everything longer. The counts stop at 0xffff.
+#define PROFILE_ISR_BUCKETS 8
+#define PROFILE_ISR_BUCKET0_SHIFT 6
+
+typedef struct {
+	uint16_t max;
+	uint16_t count[PROFILE_ISR_BUCKETS];
+} profile_isr_t;
+
+#define PROFILE_ISR_RF        0
+#define PROFILE_ISR_UART0_RX  1
+#define PROFILE_ISR_UART0_TX  2
+#define PROFILE_ISR_UART1_RX  3
+#define PROFILE_ISR_UART1_TX  4
+#define PROFILE_ISR_UART1_DMA 5
+#define PROFILE_ISR_ADC       6
+#define PROFILE_ISR_T1        7
+#define PROFILE_ISR_SITES     8
+
+#if PROFILE_ISR_ENABLED == 1 && !defined(BOOTLOADER)
+#include <cc1110.h>
+#include "timers.h"
+
+extern __xdata profile_isr_t profile_isr[PROFILE_ISR_SITES];
+extern __xdata uint16_t profile_isr_started[PROFILE_ISR_SITES];
+
+// These are macros rather than functions so that they run in the
+// register bank of the ISR, and so that an ISR preempting another one
+// only touches its own site. Reading T1CNTL latches T1CNTH.
+#define PROFILE_ISR_ENTER(site) do { \
+		profile_isr_started[site] = T1CNTL; \
+		profile_isr_started[site] |= T1CNTH << 8; \
+	} while (0)
+
+#if TIMERS_TICKLESS == 1
+// The counter runs over all 16 bits, so the subtraction wraps by itself
+#define PROFILE_ISR_UNWRAP(elapsed)
+#else
+// No ISR takes anywhere near a millisecond, so a counter that went
+// backwards wrapped once
+#define PROFILE_ISR_UNWRAP(elapsed) \
+	if (elapsed >= T1_PERIOD) { \
+		elapsed += T1_PERIOD; \
+	}
+#endif
+
+#define PROFILE_ISR_EXIT(site) do { \
+		uint16_t profile_elapsed; \
+		uint8_t profile_bucket; \
+		profile_elapsed = T1CNTL; \
+		profile_elapsed |= T1CNTH << 8; \
+		profile_elapsed -= profile_isr_started[site]; \
+		PROFILE_ISR_UNWRAP(profile_elapsed) \
+		if (profile_elapsed > profile_isr[site].max) { \
+			profile_isr[site].max = profile_elapsed; \
+		} \
+		profile_elapsed >>= PROFILE_ISR_BUCKET0_SHIFT; \
+		profile_bucket = 0; \
+		while (profile_elapsed && profile_bucket < PROFILE_ISR_BUCKETS - 1) { \
+			profile_elapsed >>= 1; \
+			profile_bucket++; \
+		} \
+		if (profile_isr[site].count[profile_bucket] != 0xffff) { \
+			profile_isr[site].count[profile_bucket]++; \
+		} \
+	} while (0)
+#else
+#define PROFILE_ISR_ENTER(site)
+#define PROFILE_ISR_EXIT(site)
+#endif
+
+#endif
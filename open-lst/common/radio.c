@@ -19,10 +19,13 @@
 #include "cc1110_regs.h"
 #include "crc16.h"
 #include "dma.h"
+#include "events.h"
+#include "profile_isr.h"
 #include "radio.h"
 #include "stringx.h"
 
 #ifndef BOOTLOADER
+#include "fec.h"
 #include "timers.h"
 #pragma codeseg APP_UPDATER
 #endif
@@ -49,6 +52,8 @@ __xdata uint32_t radio_packets_good;
 __xdata uint32_t radio_packets_rejected_checksum;
 __xdata uint32_t radio_packets_rejected_reserved;
 __xdata uint32_t radio_packets_rejected_other;
+__xdata uint32_t radio_packets_rs_corrected;
+__xdata uint32_t radio_rs_symbols_corrected;
 
 volatile __bit rf_mode_tx = 0;  // controls whether the rftxrx ISR is transmitting or receiving
 
@@ -173,12 +178,58 @@ void radio_init(void) {
 	radio_packets_rejected_checksum = 0;
 	radio_packets_rejected_reserved = 0;
 	radio_packets_rejected_other = 0;
+	radio_packets_rs_corrected = 0;
+	radio_rs_symbols_corrected = 0;
+	#if RF_RS_ENABLED == 1 && !defined(BOOTLOADER)
+	fec_init();
+	#endif
 	// TODO: default channel?
 	radio_set_modes(RADIO_MODE_DEFAULT_RX, RADIO_MODE_DEFAULT_TX);
 }
 
 
-uint8_t radio_get_message(__xdata command_t *cmd, uint8_t *uart_sel) {
+#if RF_RS_ENABLED == 1 && !defined(BOOTLOADER)
+// Check the CRC of a received variable length frame. rf_pkt_length
+// does not include any Reed-Solomon parity.
+static uint8_t radio_rx_crc_ok(uint8_t rf_pkt_length) {
+	__xdata rf_message_footer_t *footer;
+	footer = (__xdata rf_message_footer_t *) &rf_rx_buffer.data[rf_pkt_length +
+	                                                            sizeof(rf_rx_buffer.header.length) -
+	                                                            sizeof(*footer)];
+	return crc16(&rf_rx_buffer.header.length,
+	             rf_pkt_length - sizeof(footer->crc) +
+	             sizeof(rf_rx_buffer.header.length)) == footer->crc;
+}
+
+// Try to repair a received frame with the Reed-Solomon outer code.
+// The CRC is checked first so the (comparatively slow) decoder only
+// runs on damaged frames. The decoder is also tried when the parity
+// flag is clear since the flags byte itself may be the damaged symbol.
+static void radio_rx_correct(void) {
+	uint8_t rf_pkt_length;
+	int8_t corrected;
+
+	rf_pkt_length = rf_rx_buffer.header.length;
+	if (!(PKTCTRL0 & PKTCTRL0_LENGTH_CONFIG_VARIABLE) ||
+	    rf_pkt_length < RF_RS_PARITY_BYTES + sizeof(rf_message_footer_t)) {
+		return;
+	}
+	if (radio_rx_crc_ok((rf_rx_buffer.header.flags & FLAGS_RS_PARITY) ?
+	                    rf_pkt_length - RF_RS_PARITY_BYTES : rf_pkt_length)) {
+		return;
+	}
+	// The codeword starts after the length byte and includes the parity
+	corrected = fec_rs_decode(&rf_rx_buffer.header.flags, rf_pkt_length);
+	if (corrected > 0 &&
+	    (rf_rx_buffer.header.flags & FLAGS_RS_PARITY) &&
+	    radio_rx_crc_ok(rf_pkt_length - RF_RS_PARITY_BYTES)) {
+		radio_packets_rs_corrected++;
+		radio_rs_symbols_corrected += corrected;
+	}
+}
+#endif
+
+uint8_t radio_get_message(__xdata command_t *cmd, uint8_t *flags) {
 	uint8_t rf_pkt_length;
 	uint8_t msg_length;
 	__xdata rf_message_footer_t *footer;
@@ -186,8 +237,20 @@ uint8_t radio_get_message(__xdata command_t *cmd, uint8_t *uart_sel) {
 	if (!rf_rx_complete) {
 		return 0;
 	}
+	#if RF_RS_ENABLED == 1 && !defined(BOOTLOADER)
+	radio_rx_correct();
+	#endif
 	// Make sure the packet is long enough to be parseable
 	rf_pkt_length = rf_rx_buffer.header.length;
+	#if RF_RS_ENABLED == 1
+	// Reed-Solomon parity follows the CRC and is not part of the
+	// message. The bootloader doesn't correct errors but still
+	// accepts intact frames that carry parity.
+	if ((rf_rx_buffer.header.flags & FLAGS_RS_PARITY) &&
+	    rf_pkt_length > RF_RS_PARITY_BYTES) {
+		rf_pkt_length -= RF_RS_PARITY_BYTES;
+	}
+	#endif
 	if (rf_pkt_length < sizeof(rf_rx_buffer.header.flags) + // A flags field must be included
 	                    sizeof(cmd->header) +  // The packet must have enough data to fill a command struct
 	                    sizeof(*footer) - // The packet must include the CRC footer
@@ -240,14 +303,15 @@ uint8_t radio_get_message(__xdata command_t *cmd, uint8_t *uart_sel) {
 	        msg_length);
 	// Now overwrite the length/flags bytes with the HWID
 	cmd->header.hwid = footer->hwid;
-	*uart_sel = (rf_rx_buffer.header.flags & FLAGS_UART_SEL) ? 1 : 0;
+	*flags = rf_rx_buffer.header.flags;
 	rf_rx_complete = 0;
         radio_packets_good++;
 	return msg_length;
 }
 
 // RF ISR: Packet SFD or DONE (or other RF events, see datasheet p. 188)
-void rf_isr(void)  __interrupt (RF_VECTOR) __using (1) {
+void rf_isr(void)  __interrupt (RF_VECTOR) __using (RF_ISR_BANK) {
+	PROFILE_ISR_ENTER(PROFILE_ISR_RF);
 	S1CON = 0;  // Clear RFIF_1 and RFIF_2
 	if (RFIF & RFIF_IM_TXUNF) {
 		rf_mode_tx = 0;
@@ -258,10 +322,12 @@ void rf_isr(void)  __interrupt (RF_VECTOR) __using (1) {
 	}
 	if (RFIF & RFIF_IM_DONE && !rf_mode_tx) {
 		rf_rx_complete = 1;
+		EVENT_SET(EVENT_RF);
 		RFIF = (uint8_t)~RFIF_IM_DONE;
 		radio_last_rssi = *((int8_t *) &RSSI);
 		radio_last_lqi = LQI;
 		radio_last_freqest = *((int8_t *) &FREQEST);
+		TELEMETRY_SEQ_BUMP
 	}
 	if (RFIF & RFIF_IM_SFD && !rf_mode_tx) {
 		// RX SFD - Packet reception begun (sync word detected)
@@ -269,8 +335,10 @@ void rf_isr(void)  __interrupt (RF_VECTOR) __using (1) {
 	}
 	if (RFIF & RFIF_IM_CS) {
 		radio_cs_count++;
+		TELEMETRY_SEQ_BUMP
 	}
 	RFIF = 0;
+	PROFILE_ISR_EXIT(PROFILE_ISR_RF);
 }
 
 void radio_listen(void) {
@@ -322,10 +390,13 @@ void radio_listen(void) {
 
 
 void radio_send_packet(const __xdata command_t* cmd, uint8_t len,
-                       __bit precise_timing, uint8_t uart_sel) {
+                       __bit precise_timing, uint8_t flags) {
 	__xdata rf_message_footer_t *footer;
 	uint8_t rf_extras;
 	uint8_t rf_msg_len;
+	#if RF_RS_ENABLED == 1 && !defined(BOOTLOADER)
+	__bit rs_parity;
+	#endif
 	#ifndef BOOTLOADER
 	if (precise_timing) {
 		// Enable the timer interrupt now. The interrupt will send STX
@@ -368,16 +439,32 @@ void radio_send_packet(const __xdata command_t* cmd, uint8_t len,
 	memcpyx((void __xdata *) rf_tx_buffer.data, (void __xdata *) cmd, len);
 	// Find the footer location
 	footer = (__xdata rf_message_footer_t *) &rf_tx_buffer.data[len];
-	rf_tx_buffer.header.flags = uart_sel ? FLAGS_UART1_SEL : FLAGS_UART0_SEL;
+	rf_tx_buffer.header.flags = flags;
 	// Copy the HWID over to the footer
 	footer->hwid = cmd->header.hwid;
 	if (PKTCTRL0 & PKTCTRL0_LENGTH_CONFIG_VARIABLE) {
 		// Set the length byte
 		rf_tx_buffer.header.length = rf_msg_len;
+		#if RF_RS_ENABLED == 1 && !defined(BOOTLOADER)
+		// Append the Reed-Solomon parity after the CRC if it fits.
+		// The length byte (which is covered by the CRC) includes it.
+		rs_parity = rf_msg_len < RF_BUFFER_SIZE - RF_RS_PARITY_BYTES;
+		if (rs_parity) {
+			rf_tx_buffer.header.flags |= FLAGS_RS_PARITY;
+			rf_tx_buffer.header.length += RF_RS_PARITY_BYTES;
+		}
+		#endif
 		// Compute the CRC starting at the length byte
 		footer->crc = crc16(&rf_tx_buffer.header.length,
 		                    rf_msg_len - sizeof(footer->crc) +
 		                    sizeof(rf_tx_buffer.header.length));
+		#if RF_RS_ENABLED == 1 && !defined(BOOTLOADER)
+		// The codeword is everything after the length byte
+		if (rs_parity) {
+			fec_rs_encode(&rf_tx_buffer.header.flags, rf_msg_len,
+			              &rf_tx_buffer.data[rf_msg_len + sizeof(rf_tx_buffer.header.length)]);
+		}
+		#endif
 	} else {
 		rf_tx_buffer.header.length = PKTLEN;
 		// Compute the CRC starting at the flags byte (skip length)
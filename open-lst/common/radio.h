@@ -84,7 +84,18 @@ typedef struct {
 // msg_len+1     byte 1 of the command message (HWID high byte)
 // msg_len+2     low byte of the CRC
 // msg_len+3     high byte of the CRC
-
+//
+// When the Reed-Solomon outer code is enabled (RF_RS_ENABLED), the
+// FLAGS_RS_PARITY flag is set and RF_RS_PARITY_BYTES of parity follow
+// the CRC. The length byte includes the parity. The codeword covers
+// everything after the length byte.
+//
+// FLAGS_COMPRESSED marks payload messages whose bytes after the
+// system field have been compressed (see radio/compress.h). They are
+// forwarded to UART1 as-is for the ground software to expand.
+
+#define FLAGS_COMPRESSED (1<<4)
+#define FLAGS_RS_PARITY (1<<5)
 #define FLAGS_UART_SEL  (1<<6)
 #define FLAGS_UART0_SEL (0<<6)
 #define FLAGS_UART1_SEL (1<<6)
@@ -105,13 +116,21 @@ typedef union {
 	rf_message_header_t header;
 } rf_buffer_t;
 
-void rf_isr(void)  __interrupt (RF_VECTOR) __using (1);
+// With UART1 DMA receive, uart1_init raises this ISR's priority group
+// (shared with DMA) to UART1's, so it shares UART1's register bank too.
+// board_defaults.h includes this after CONFIG_UART1_RX_DMA is set.
+#if CONFIG_UART1_RX_DMA == 1 && !defined(BOOTLOADER)
+#define RF_ISR_BANK 2
+#else
+#define RF_ISR_BANK 1
+#endif
+void rf_isr(void)  __interrupt (RF_VECTOR) __using (RF_ISR_BANK);
 void radio_set_modes(uint8_t rx_mode, uint8_t tx_mode);
-uint8_t radio_get_message(__xdata command_t *cmd, uint8_t *uart_sel);
+uint8_t radio_get_message(__xdata command_t *cmd, uint8_t *flags);
 void radio_init(void);
 void radio_listen(void);
 void radio_send_packet(const __xdata command_t* cmd, uint8_t len,
-                       __bit precise_timing, uint8_t uart_sel);
+                       __bit precise_timing, uint8_t flags);
 
 extern uint8_t radio_mode_tx;
 extern uint8_t radio_mode_rx;
@@ -127,5 +146,7 @@ extern __xdata uint32_t radio_packets_good;
 extern __xdata uint32_t radio_packets_rejected_checksum;
 extern __xdata uint32_t radio_packets_rejected_reserved;
 extern __xdata uint32_t radio_packets_rejected_other;
+extern __xdata uint32_t radio_packets_rs_corrected;
+extern __xdata uint32_t radio_rs_symbols_corrected;
 
 #endif
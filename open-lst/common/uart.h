@@ -20,14 +20,35 @@
 
 #define ESP_START_BYTE_0 0x22           /** First start byte  */
 #define ESP_START_BYTE_1 0x69           /** Second start byte  */
+#define ESP_START_BYTE_1_LZ 0x6A        /** Second start byte (compressed message) */
+#define ESP_START_BYTE_1_V2 0x6B        /** Second start byte (v2 frame) */
 #define ESP_MAX_PAYLOAD 251
+#define ESP_HEADER_SIZE 3               /** Start bytes and length */
+
+// A v2 frame is:
+//   0x22 0x6B len ~len flags [msg_len msg]... crc_lo crc_hi
+// len counts the flags and messages. The CRC (crc16) covers the same
+// bytes. The receive buffer holds everything after ~len.
+#define ESP2_HEADER_SIZE 4              /** Start bytes, length and its complement */
+#define ESP2_FLAGS_SIZE 1
+#define ESP2_CRC_SIZE 2
+#define ESP2_MAX_FRAME (ESP_MAX_PAYLOAD - ESP2_CRC_SIZE)
+#define ESP2_MAX_MESSAGE (ESP2_MAX_FRAME - ESP2_FLAGS_SIZE - 1)
+#define ESP2_FLAG_LZ (1<<0)             /** Messages are LZSS compressed */
+// The application's transmit rings are indexed with a uint8_t so
+// the size must stay at 256
+#define UART_TX_RING_SIZE 256
 #define RTS_OK   0
 #define RTS_WAIT 1
+#define CTS_OK   0
+#define CTS_WAIT 1
 
 typedef enum {
   wait_for_start0,
   wait_for_start1,
   wait_for_length,
+  wait_for_length_v2,
+  wait_for_length_check,
   receive_data
 } esp_state_t;
 
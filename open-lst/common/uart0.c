@@ -23,27 +23,85 @@
 #include <stdint.h>
 #include "cc1110_regs.h"
 #include "board_defaults.h"
+#include "compiler_utils.h"
+#include "commands.h"
 #include "hwid.h"
+#include "profile_isr.h"
 #include "uart.h"
 #include "uart0.h"
+#include "events.h"
 #include "stringx.h"
+#if CONFIG_UART_ESP2 == 1 && !defined(BOOTLOADER)
+#include "crc16.h"
+
+#define UART0_ESP2
+#endif
 
 volatile __data uint32_t uart0_rx_count;
+volatile __xdata uint32_t uart0_rx_dropped;
+#if CONFIG_UART0_USE_FLOW_CTRL == 1 && !defined(BOOTLOADER)
+volatile __xdata uint32_t uart0_rts_stall_ms;
+#endif
+#if CONFIG_UART0_USE_CTS == 1 && !defined(BOOTLOADER)
+volatile __bit uart0_tx_cts_wait;
+#endif
 
 static esp_state_t __data rx_esp_state;
-static uint8_t __data rx_buffer_ready[UART0_RX_BUFFERS];
+// Receive buffers are filled and handed out in order, so they
+// form a ring. The ISR fills rx_active_buffer and the main loop
+// leases rx_lease_buffer. The two counters only ever increase and
+// their difference is the number of buffers waiting to be handled.
+static volatile uint8_t __data rx_buffers_filled;
+static volatile uint8_t __data rx_buffers_released;
 static uint8_t __data rx_buffer_len[UART0_RX_BUFFERS];
 static uint8_t __data rx_active_buffer;
+static uint8_t __data rx_lease_buffer;
 static uint8_t __data rx_buffer_offset;
 static uint8_t __xdata rx_buffer[UART0_RX_BUFFERS][ESP_MAX_PAYLOAD];
-static uint8_t __xdata tx_buffer[ESP_MAX_PAYLOAD];
+#ifdef UART0_ESP2
+// The receiving frame (and each buffer) is v1 or v2. For a v2
+// frame the main loop hands out one message at a time starting at
+// rx_lease_offset, which is 0 until the frame's CRC is checked.
+static __bit rx_v2;
+static uint8_t __data rx_v2_len;
+static uint8_t __xdata rx_buffer_v2[UART0_RX_BUFFERS];
+static uint8_t __xdata rx_lease_offset;
+// Replies use v2 framing once the host has sent a v2 frame
+static __bit tx_v2;
+#endif
+
+#if CONFIG_UART0_USE_FLOW_CTRL == 1
+STATIC_ASSERT(uart0_rts_reserve_valid, CONFIG_UART0_RTS_RESERVE < UART0_RX_BUFFERS);
+
+// Ask the host to pause once only the reserve of free buffers
+// is left, and let it carry on once a buffer is released
+#define uart0_rts_update() \
+	CONFIG_UART0_FLOW_PIN = \
+		((uint8_t) (rx_buffers_filled - rx_buffers_released) >= \
+		 UART0_RX_BUFFERS - CONFIG_UART0_RTS_RESERVE) ? RTS_WAIT : RTS_OK
+#else
+#define uart0_rts_update()
+#endif
+#if UART0_ENABLED == 1 && !defined(BOOTLOADER)
+// Transmit ring drained by the TX ISR. The head is only moved by
+// the main loop and the tail only by the ISR. One slot is left
+// empty to tell a full ring from an empty one.
+static uint8_t __xdata tx_buffer[UART_TX_RING_SIZE];
+static volatile uint8_t __data tx_head;
+static volatile uint8_t __data tx_tail;
+#endif
 
 #if UART0_ENABLED == 1
 void uart0_init(void) {
-	uint8_t b;
-
-	// Initialize the receive counter
+	// Initialize the receive counters
 	uart0_rx_count = 0;
+	uart0_rx_dropped = 0;
+	#if CONFIG_UART0_USE_FLOW_CTRL == 1 && !defined(BOOTLOADER)
+	uart0_rts_stall_ms = 0;
+	#endif
+	#if CONFIG_UART0_USE_CTS == 1 && !defined(BOOTLOADER)
+	uart0_tx_cts_wait = 0;
+	#endif
 	// Select the "alternate 2" pin configuration for UART0
 	PERCFG |= 1<<0;
 	// Set the TX pin of "alternate 2" to be an output
@@ -59,7 +117,6 @@ void uart0_init(void) {
 	// For CONFIG_UART0_CGR, 12 = 115200 baud, 14 = 460800 baud
 	U0GCR = CONFIG_UART0_GCR; // U0GCR[4:0] is BAUD_M
 
-	// TODO: flow control
 	// TODO: High priority ISR
 
 	U0CSR = (1<<7) | // UART mode (not SPI)
@@ -68,11 +125,21 @@ void uart0_init(void) {
 
 
 	// Clear any rx buffers
-	for (b = 0; b < UART0_RX_BUFFERS; b++) {
-		rx_buffer_ready[b] = 0;
-	}
+	rx_buffers_filled = 0;
+	rx_buffers_released = 0;
+	rx_active_buffer = 0;
+	rx_lease_buffer = 0;
 
-	// TODO: flow control
+	// RTS and CTS are driven and read as GPIO since the frame
+	// level backpressure is done in software
+#if CONFIG_UART0_USE_FLOW_CTRL == 1
+	P1DIR |= 1<<3;
+	CONFIG_UART0_FLOW_PIN = RTS_OK;
+#endif
+#if CONFIG_UART0_USE_CTS == 1
+	P1SEL &= ~(1<<2);
+	P1DIR &= ~(1<<2);
+#endif
 
 	// TODO: these look redundant
 	IEN2 &= ~IEN2_UTX0IE; // disable the tx interrupt (which one is it?)
@@ -84,36 +151,157 @@ void uart0_init(void) {
 }
 
 
-uint8_t uart0_get_message(__xdata uint8_t *buf) {
-	// If there is a completed message in a buffer,
-	// this function will copy that message to buf
-	// and return the length in bytes.
-	// If no messages are ready, buf is left unchanged
-	// and 0 is returned.
-	uint8_t i;
+static void uart0_free_buffer(void) {
+	if (++rx_lease_buffer == UART0_RX_BUFFERS) {
+		rx_lease_buffer = 0;
+	}
+	#ifdef UART0_ESP2
+	rx_lease_offset = 0;
+	#endif
+	// The ISR also updates RTS so keep it out until we're done
+	__critical {
+		rx_buffers_released++;
+		uart0_rts_update();
+	}
+}
+
+// Hand the oldest completed message to the caller without copying
+// it. Returns the message length and points *buf at it, or returns
+// 0 if no messages are ready. The buffer stays with the caller (and
+// this returns the same message) until uart0_release_message.
+uint8_t uart0_lease_message(__xdata command_buffer_t **buf) {
+	#ifdef UART0_ESP2
+	__xdata uint8_t *frame;
+	uint8_t end;
 	uint8_t len;
-	for (i = 0; i < UART0_RX_BUFFERS; i++) {
-		if (rx_buffer_ready[i]) {
-			// Copy the message to the output buffer
-			len = rx_buffer_len[i];
-			memcpyx(buf, rx_buffer[i], len);
-			// Release the buffer
-			rx_buffer_ready[i] = 0;
+	#endif
+
+	while (rx_buffers_filled != rx_buffers_released) {
+		#ifdef UART0_ESP2
+		if (rx_buffer_v2[rx_lease_buffer]) {
+			frame = rx_buffer[rx_lease_buffer];
+			end = rx_buffer_len[rx_lease_buffer] - ESP2_CRC_SIZE;
+			if (rx_lease_offset == 0) {
+				// Compressed input isn't supported. A bad frame
+				// costs only its own buffer since the length was
+				// already checked against its complement.
+				if (crc16(frame, end) != (frame[end] | frame[end + 1] << 8) ||
+				    (frame[0] & ESP2_FLAG_LZ)) {
+					uart0_rx_dropped++;
+					uart0_free_buffer();
+					continue;
+				}
+				tx_v2 = 1;
+				rx_lease_offset = ESP2_FLAGS_SIZE;
+			}
+			len = frame[rx_lease_offset];
+			if (len == 0 || (uint16_t) rx_lease_offset + 1 + len > end) {
+				// Malformed batch, drop the rest of it
+				uart0_free_buffer();
+				continue;
+			}
+			*buf = (__xdata command_buffer_t *) &frame[rx_lease_offset + 1];
 			return len;
 		}
+		tx_v2 = 0;
+		#endif
+		*buf = (__xdata command_buffer_t *) rx_buffer[rx_lease_buffer];
+		return rx_buffer_len[rx_lease_buffer];
 	}
-	// No finished buffers found
 	return 0;
 }
 
-void uart0_put(char c) {
-  while (!UTX0IF);
-  U0DBUF = c;
-  UTX0IF = 0;
+// Give the leased message back. The buffer goes back to the receive
+// ISR once every message in it has been handled.
+void uart0_release_message(void) {
+	#ifdef UART0_ESP2
+	if (rx_buffer_v2[rx_lease_buffer]) {
+		rx_lease_offset += 1 + rx_buffer[rx_lease_buffer][rx_lease_offset];
+		if (rx_lease_offset < rx_buffer_len[rx_lease_buffer] - ESP2_CRC_SIZE) {
+			// More messages in this frame
+			EVENT_SET(EVENT_UART0);
+			return;
+		}
+	}
+	#endif
+	uart0_free_buffer();
+	#ifndef BOOTLOADER
+	if (rx_buffers_filled != rx_buffers_released) {
+		EVENT_SET(EVENT_UART0);
+	}
+	#endif
+}
+
+#ifdef BOOTLOADER
+// The bootloader has no TX interrupt so it writes straight
+// to the UART
+static void uart0_put(uint8_t c) {
+	while (!UTX0IF);
+	U0DBUF = c;
+	UTX0IF = 0;
 }
+#define uart0_tx_free() 0xff
+#define uart0_tx_wait(len)
+#define uart0_tx_start()
+#else
+static uint8_t uart0_tx_free(void) {
+	return tx_tail - tx_head - 1;
+}
+
+// Only block if the ring is too full to take the whole frame
+static void uart0_tx_wait(uint8_t len) {
+	while (uart0_tx_free() < len);
+}
+
+static void uart0_put(uint8_t c) {
+	tx_buffer[tx_head] = c;
+	tx_head++;
+}
+
+// (Re)enable the TX interrupt. UTX0IF is left set while the
+// UART is idle so this fires straight away.
+#define uart0_tx_start() IEN2 |= IEN2_UTX0IE
+#endif
+
+#ifdef UART0_ESP2
+// Queue a message as a v2 frame (on its own) with a CRC
+static void uart0_send_frame_v2(uint8_t flags, const __xdata uint8_t *msg, uint8_t len) {
+	uint8_t frame_len;
+	uint16_t crc;
 
-// TODO: use interrupts
+	frame_len = ESP2_FLAGS_SIZE + 1 + len;
+	uart0_tx_wait(ESP2_HEADER_SIZE + frame_len + ESP2_CRC_SIZE);
+	uart0_put(ESP_START_BYTE_0);
+	uart0_put(ESP_START_BYTE_1_V2);
+	uart0_put(frame_len);
+	uart0_put(~frame_len);
+	crc16_start();
+	uart0_put(flags);
+	crc16_add(flags);
+	uart0_put(len);
+	crc16_add(len);
+	while (len--) {
+		crc16_add(*msg);
+		uart0_put(*(msg++));
+	}
+	crc = crc16_result();
+	uart0_put(crc & 0xff);
+	uart0_put(crc >> 8);
+	uart0_tx_start();
+}
+#endif
+
+// Queue a message for transmission. This only waits if the
+// transmit ring is full.
 void uart0_send_message(const __xdata uint8_t *msg, uint8_t len) {
+	#ifdef UART0_ESP2
+	// Messages too long for a v2 frame still go out as v1
+	if (tx_v2 && len <= ESP2_MAX_MESSAGE) {
+		uart0_send_frame_v2(0, msg, len);
+		return;
+	}
+	#endif
+	uart0_tx_wait(len + ESP_HEADER_SIZE);
 	// ESP header
 	uart0_put(ESP_START_BYTE_0);
 	uart0_put(ESP_START_BYTE_1);
@@ -121,23 +309,39 @@ void uart0_send_message(const __xdata uint8_t *msg, uint8_t len) {
 	while (len--) {
 		uart0_put(*(msg++));
 	}
+	uart0_tx_start();
 }
 
-static __xdata command_t print_buf;
-
-// Send a string out the UART as an "ASCII" command
+// Send a string out the UART as an "ASCII" command. The message is
+// dropped rather than waiting for room in the transmit ring.
 void dprintf0(const char * msg) {
 	uint8_t len;
-	print_buf.header.hwid = hwid_flash;
+	hwid_t hwid;
+
+	len = strlen(msg);
+	if (len > ESP_MAX_PAYLOAD - sizeof(command_header_t)) {
+		len = ESP_MAX_PAYLOAD - sizeof(command_header_t);
+	}
+	if (uart0_tx_free() < ESP_HEADER_SIZE + sizeof(command_header_t) + len) {
+		return;
+	}
+	uart0_put(ESP_START_BYTE_0);
+	uart0_put(ESP_START_BYTE_1);
+	uart0_put(sizeof(command_header_t) + len);
+	hwid = hwid_flash;
+	uart0_put(hwid & 0xff);
+	uart0_put(hwid >> 8);
 	// TODO no hardcode
-	print_buf.header.seqnum = 0;
-	print_buf.header.system = MSG_TYPE_RADIO_OUT;
-	print_buf.header.command = common_msg_ascii;
-	len = strcpylenx((__xdata void *) print_buf.data, (__xdata void *) msg);
-	uart0_send_message((__xdata void *) &print_buf, len + sizeof(print_buf.header));
+	uart0_put(0);  // seqnum
+	uart0_put(0);
+	uart0_put(MSG_TYPE_RADIO_OUT);
+	uart0_put(common_msg_ascii);
+	while (len--) {
+		uart0_put(*(msg++));
+	}
+	uart0_tx_start();
 }
 
-
 // UART ISR
 //
 // For high baud rates (460800), this ISR must complete as fast as
@@ -155,6 +359,7 @@ void dprintf0(const char * msg) {
 void uart0_rx_isr() __interrupt (URX0_VECTOR) __using (3) {
 	uint8_t c;
 
+	PROFILE_ISR_ENTER(PROFILE_ISR_UART0_RX);
 	c = U0DBUF;
 	switch (rx_esp_state) {
 		case wait_for_start0:
@@ -167,27 +372,56 @@ void uart0_rx_isr() __interrupt (URX0_VECTOR) __using (3) {
 		case wait_for_start1:
 			if (c == ESP_START_BYTE_1) {
 				rx_esp_state = wait_for_length;
+				#ifdef UART0_ESP2
+				rx_v2 = 0;
+			} else if (c == ESP_START_BYTE_1_V2) {
+				rx_esp_state = wait_for_length_v2;
+				rx_v2 = 1;
+				#endif
 			} else if (c == ESP_START_BYTE_0) {
 				rx_esp_state = wait_for_start1;
 			}
 			break;
 
+		#ifdef UART0_ESP2
+		case wait_for_length_v2:
+			// At least the flags and one message length
+			if (c > ESP2_MAX_FRAME || c < ESP2_FLAGS_SIZE + 1) {
+				rx_esp_state = (c == ESP_START_BYTE_0) ? wait_for_start1 : wait_for_start0;
+			} else {
+				rx_v2_len = c;
+				rx_esp_state = wait_for_length_check;
+			}
+			break;
+
+		case wait_for_length_check:
+			// A corrupted length is caught here rather than
+			// swallowing the frames that follow it
+			if (c != (uint8_t) ~rx_v2_len) {
+				rx_esp_state = (c == ESP_START_BYTE_0) ? wait_for_start1 : wait_for_start0;
+				break;
+			}
+			// The CRC is received (and checked later) with the rest
+			c = rx_v2_len + ESP2_CRC_SIZE;
+			// fall through
+		#endif
 		case wait_for_length:
 			if (c > ESP_MAX_PAYLOAD || c < 1) {
 				// Skip this packet if it is too long to handle
 				rx_esp_state = wait_for_start1;
 			} else {
-				// Find a free buffer
-				rx_active_buffer = 0;
-				while (rx_buffer_ready[rx_active_buffer]) {
-					rx_active_buffer++;
-				}
-				if (rx_active_buffer >= UART0_RX_BUFFERS) {
+				// The next buffer in the ring is free unless
+				// they are all waiting to be handled
+				if ((uint8_t) (rx_buffers_filled - rx_buffers_released) == UART0_RX_BUFFERS) {
 					// No free buffers, just skip this packet
-					rx_active_buffer = 0;
+					uart0_rx_dropped++;
+					TELEMETRY_SEQ_BUMP
 					rx_esp_state = wait_for_start0;
 				} else {
 					rx_buffer_len[rx_active_buffer] = c;
+					#ifdef UART0_ESP2
+					rx_buffer_v2[rx_active_buffer] = rx_v2;
+					#endif
 					rx_buffer_offset = 0;
 					rx_esp_state = receive_data;
 				}
@@ -198,12 +432,51 @@ void uart0_rx_isr() __interrupt (URX0_VECTOR) __using (3) {
 			rx_buffer[rx_active_buffer][rx_buffer_offset++] = c;
 			if (rx_buffer_offset == rx_buffer_len[rx_active_buffer]) {
 				// This packet is done
-				rx_buffer_ready[rx_active_buffer] = 1;
+				if (++rx_active_buffer == UART0_RX_BUFFERS) {
+					rx_active_buffer = 0;
+				}
+				rx_buffers_filled++;
+				uart0_rts_update();
+				EVENT_SET(EVENT_UART0);
 				rx_esp_state = wait_for_start0;
 				uart0_rx_count++;
+				TELEMETRY_SEQ_BUMP
 			}
 			break;
 	}
+	PROFILE_ISR_EXIT(PROFILE_ISR_UART0_RX);
+}
+
+#ifndef BOOTLOADER
+// UART TX ISR
+//
+// Feeds the next byte from the transmit ring. This shares the
+// priority group (and so the register bank) of the RX ISR.
+// When the ring is empty (or CTS says the host can't take any
+// more) the interrupt is disabled but UTX0IF is left set so
+// that re-enabling it restarts transmission.
+void uart0_tx_isr() __interrupt (UTX0_VECTOR) __using (3) {
+	PROFILE_ISR_ENTER(PROFILE_ISR_UART0_TX);
+	if (tx_tail == tx_head) {
+		IEN2 &= ~IEN2_UTX0IE;
+		PROFILE_ISR_EXIT(PROFILE_ISR_UART0_TX);
+		return;
+	}
+	#if CONFIG_UART0_USE_CTS == 1
+	if (CONFIG_UART0_CTS_PIN == CTS_WAIT) {
+		// The host isn't ready. The timer tick restarts us
+		// once it is (see UART0_FLOW_TICK).
+		IEN2 &= ~IEN2_UTX0IE;
+		uart0_tx_cts_wait = 1;
+		PROFILE_ISR_EXIT(PROFILE_ISR_UART0_TX);
+		return;
+	}
+	#endif
+	UTX0IF = 0;
+	U0DBUF = tx_buffer[tx_tail];
+	tx_tail++;
+	PROFILE_ISR_EXIT(PROFILE_ISR_UART0_TX);
 }
+#endif
 
 #endif
@@ -19,8 +19,9 @@
 
 #include <cc1110.h>
 #include <stdint.h>
+#include "commands.h"
 
-#ifndef UART1_RX_BUFFERS
+#ifndef UART0_RX_BUFFERS
 // By default, UART0 is the "low speed" interface
 // for simple command and response workflows and
 // only has a single buffer.
@@ -32,8 +33,12 @@
 #endif
 
 void uart0_rx_isr() __interrupt (URX0_VECTOR) __using (3);
+#ifndef BOOTLOADER
+void uart0_tx_isr() __interrupt (UTX0_VECTOR) __using (3);
+#endif
 void uart0_init(void);
-uint8_t uart0_get_message(__xdata uint8_t *buf);
+uint8_t uart0_lease_message(__xdata command_buffer_t **buf);
+void uart0_release_message(void);
 void uart0_send_message(const __xdata uint8_t *msg, uint8_t len);
 
 // TODO: better
@@ -41,5 +46,38 @@ void dprintf0(const char *msg);
 // void dprintf2(char * msg, uint8_t val);
 
 extern volatile __data uint32_t uart0_rx_count;
+extern volatile __xdata uint32_t uart0_rx_dropped;
+
+#ifndef BOOTLOADER
+#if CONFIG_UART0_USE_FLOW_CTRL == 1
+extern volatile __xdata uint32_t uart0_rts_stall_ms;
+#endif
+#if CONFIG_UART0_USE_CTS == 1
+extern volatile __bit uart0_tx_cts_wait;
+#endif
+
+// Called from the Timer 1 ISR every ms milliseconds (1, or about 2.4
+// with TIMERS_TICKLESS) to count the time spent holding off the host
+// and to restart transmission once CTS clears
+#if CONFIG_UART0_USE_FLOW_CTRL == 1
+#define UART0_RTS_TICK(ms) \
+	if (CONFIG_UART0_FLOW_PIN == RTS_WAIT) { \
+		uart0_rts_stall_ms += (ms); \
+		TELEMETRY_SEQ_BUMP \
+	}
+#else
+#define UART0_RTS_TICK(ms)
+#endif
+#if CONFIG_UART0_USE_CTS == 1
+#define UART0_CTS_TICK \
+	if (uart0_tx_cts_wait && CONFIG_UART0_CTS_PIN == CTS_OK) { \
+		uart0_tx_cts_wait = 0; \
+		IEN2 |= IEN2_UTX0IE; \
+	}
+#else
+#define UART0_CTS_TICK
+#endif
+#define UART0_FLOW_TICK(ms) UART0_RTS_TICK(ms) UART0_CTS_TICK
+#endif
 
 #endif
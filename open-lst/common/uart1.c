@@ -23,27 +23,90 @@
 #include <stdint.h>
 #include "cc1110_regs.h"
 #include "board_defaults.h"
+#include "compiler_utils.h"
+#include "commands.h"
 #include "hwid.h"
+#include "profile_isr.h"
 #include "uart.h"
 #include "uart1.h"
+#include "events.h"
 #include "stringx.h"
+#if CONFIG_UART_ESP2 == 1 && !defined(BOOTLOADER)
+#include "crc16.h"
+
+#define UART1_ESP2
+#endif
+#if CONFIG_UART1_RX_DMA == 1 && !defined(BOOTLOADER)
+#include "dma.h"
+
+#define UART1_RX_DMA
+#endif
 
 volatile __data uint32_t uart1_rx_count;
+volatile __xdata uint32_t uart1_rx_dropped;
+#if CONFIG_UART1_USE_FLOW_CTRL == 1 && !defined(BOOTLOADER)
+volatile __xdata uint32_t uart1_rts_stall_ms;
+#endif
+#if CONFIG_UART1_USE_CTS == 1 && !defined(BOOTLOADER)
+volatile __bit uart1_tx_cts_wait;
+#endif
 
 static esp_state_t __data rx_esp_state;
-static uint8_t __data rx_buffer_ready[UART1_RX_BUFFERS];
+// Receive buffers are filled and handed out in order, so they
+// form a ring. The ISR fills rx_active_buffer and the main loop
+// leases rx_lease_buffer. The two counters only ever increase and
+// their difference is the number of buffers waiting to be handled.
+static volatile uint8_t __data rx_buffers_filled;
+static volatile uint8_t __data rx_buffers_released;
 static uint8_t __data rx_buffer_len[UART1_RX_BUFFERS];
 static uint8_t __data rx_active_buffer;
+static uint8_t __data rx_lease_buffer;
 static uint8_t __data rx_buffer_offset;
 static uint8_t __xdata rx_buffer[UART1_RX_BUFFERS][ESP_MAX_PAYLOAD];
-static uint8_t __xdata tx_buffer[ESP_MAX_PAYLOAD];
+#ifdef UART1_ESP2
+// The receiving frame (and each buffer) is v1 or v2. For a v2
+// frame the main loop hands out one message at a time starting at
+// rx_lease_offset, which is 0 until the frame's CRC is checked.
+static __bit rx_v2;
+static uint8_t __data rx_v2_len;
+static uint8_t __xdata rx_buffer_v2[UART1_RX_BUFFERS];
+static uint8_t __xdata rx_lease_offset;
+// Replies use v2 framing once the host has sent a v2 frame
+static __bit tx_v2;
+#endif
+
+#if CONFIG_UART1_USE_FLOW_CTRL == 1
+STATIC_ASSERT(uart1_rts_reserve_valid, CONFIG_UART1_RTS_RESERVE < UART1_RX_BUFFERS);
+
+// Ask the host to pause once only the reserve of free buffers
+// is left, and let it carry on once a buffer is released
+#define uart1_rts_update() \
+	CONFIG_UART1_FLOW_PIN = \
+		((uint8_t) (rx_buffers_filled - rx_buffers_released) >= \
+		 UART1_RX_BUFFERS - CONFIG_UART1_RTS_RESERVE) ? RTS_WAIT : RTS_OK
+#else
+#define uart1_rts_update()
+#endif
+#if UART1_ENABLED == 1 && !defined(BOOTLOADER)
+// Transmit ring drained by the TX ISR. The head is only moved by
+// the main loop and the tail only by the ISR. One slot is left
+// empty to tell a full ring from an empty one.
+static uint8_t __xdata tx_buffer[UART_TX_RING_SIZE];
+static volatile uint8_t __data tx_head;
+static volatile uint8_t __data tx_tail;
+#endif
 
 #if UART1_ENABLED == 1
 void uart1_init(void) {
-	uint8_t b;
-
-	// Initialize the receive counter
+	// Initialize the receive counters
 	uart1_rx_count = 0;
+	uart1_rx_dropped = 0;
+	#if CONFIG_UART1_USE_FLOW_CTRL == 1 && !defined(BOOTLOADER)
+	uart1_rts_stall_ms = 0;
+	#endif
+	#if CONFIG_UART1_USE_CTS == 1 && !defined(BOOTLOADER)
+	uart1_tx_cts_wait = 0;
+	#endif
 
 	// Give USART1 priority on port 2
 	// USART0 defaults to this port so this is necessary
@@ -68,9 +131,10 @@ void uart1_init(void) {
 	U1GCR = CONFIG_UART1_GCR; // U0GCR[4:0] is BAUD_M
 
 	// Clear any rx buffers
-	for (b = 0; b < UART1_RX_BUFFERS; b++) {
-		rx_buffer_ready[b] = 0;
-	}
+	rx_buffers_filled = 0;
+	rx_buffers_released = 0;
+	rx_active_buffer = 0;
+	rx_lease_buffer = 0;
 
 	U1CSR = (1<<7) | // UART mode (not SPI)
 	        (1<<6);  // receiver enable
@@ -85,16 +149,46 @@ void uart1_init(void) {
 	// TODO make this an option?
 	IP0 |= IP0_IPG3;
 	IP1 &= ~(IP1_IPG3);
+	#ifdef UART1_RX_DMA
+	// The RX ISR is off from the end of a payload until the DMA ISR
+	// turns it back on, so that has to happen within about a character
+	// too. Put the DMA ISR's group (IPG0, shared with the RF ISR) at
+	// the same priority.
+	IP0 |= IP0_IPG0;
+	IP1 &= ~(IP1_IPG0);
+	#endif
 
-#if defined(CONFIG_UART1_USE_FLOW_CTRL)
+#if CONFIG_UART1_USE_FLOW_CTRL == 1
 	P0DIR |= 1<<3;
 	CONFIG_UART1_FLOW_PIN = RTS_OK;
 #endif
+#if CONFIG_UART1_USE_CTS == 1
+	// CTS is read as a plain GPIO input
+	P0SEL &= ~(1<<2);
+	P0DIR &= ~(1<<2);
+#endif
 
 	// TODO: these look redundant
 
 	IEN2 &= ~IEN2_UTX1IE; // disable the tx interrupt
 
+	#ifdef UART1_RX_DMA
+	// Payload bytes are copied from U1DBUF by DMA. The destination
+	// and length are filled in by the RX ISR for each frame.
+	dma_configure_transfer(
+		dma_channel_uart1_rx,
+		&X_U1DBUF,
+		0,
+		DMA_WORDSIZE_8_BIT |
+		DMA_TMODE_SINGLE |
+		DMA_TRIG_URX1,
+		DMA_SRCINC_ZERO |
+		DMA_DESTINC_ONE |
+		DMA_IRQMASK_ENABLE |
+		DMA_PRIORITY_HIGH);
+	DMAIE = 1;
+	#endif
+
 	URX1IE = 1; // enable RX interrupt
 	UTX1IF = 1; // set the TX interrupt (ready for data)
 	IEN0 |= IEN0_URX1IE;
@@ -102,58 +196,200 @@ void uart1_init(void) {
 }
 
 
-uint8_t uart1_get_message(__xdata uint8_t *buf) {
-	// If there is a completed message in a buffer,
-	// this function will copy that message to buf
-	// and return the length in bytes.
-	// If no messages are ready, buf is left unchanged
-	// and 0 is returned.
-	uint8_t i;
+static void uart1_free_buffer(void) {
+	if (++rx_lease_buffer == UART1_RX_BUFFERS) {
+		rx_lease_buffer = 0;
+	}
+	#ifdef UART1_ESP2
+	rx_lease_offset = 0;
+	#endif
+	// The ISR also updates RTS so keep it out until we're done
+	__critical {
+		rx_buffers_released++;
+		uart1_rts_update();
+	}
+}
+
+// Hand the oldest completed message to the caller without copying
+// it. Returns the message length and points *buf at it, or returns
+// 0 if no messages are ready. The buffer stays with the caller (and
+// this returns the same message) until uart1_release_message.
+uint8_t uart1_lease_message(__xdata command_buffer_t **buf) {
+	#ifdef UART1_ESP2
+	__xdata uint8_t *frame;
+	uint8_t end;
 	uint8_t len;
-	for (i = 0; i < UART1_RX_BUFFERS; i++) {
-		if (rx_buffer_ready[i]) {
-			// Copy the message to the output buffer
-			len = rx_buffer_len[i];
-			memcpyx(buf, rx_buffer[i], len);
-			// Release the buffer
-			rx_buffer_ready[i] = 0;
+	#endif
+
+	while (rx_buffers_filled != rx_buffers_released) {
+		#ifdef UART1_ESP2
+		if (rx_buffer_v2[rx_lease_buffer]) {
+			frame = rx_buffer[rx_lease_buffer];
+			end = rx_buffer_len[rx_lease_buffer] - ESP2_CRC_SIZE;
+			if (rx_lease_offset == 0) {
+				// Compressed input isn't supported. A bad frame
+				// costs only its own buffer since the length was
+				// already checked against its complement.
+				if (crc16(frame, end) != (frame[end] | frame[end + 1] << 8) ||
+				    (frame[0] & ESP2_FLAG_LZ)) {
+					uart1_rx_dropped++;
+					uart1_free_buffer();
+					continue;
+				}
+				tx_v2 = 1;
+				rx_lease_offset = ESP2_FLAGS_SIZE;
+			}
+			len = frame[rx_lease_offset];
+			if (len == 0 || (uint16_t) rx_lease_offset + 1 + len > end) {
+				// Malformed batch, drop the rest of it
+				uart1_free_buffer();
+				continue;
+			}
+			*buf = (__xdata command_buffer_t *) &frame[rx_lease_offset + 1];
 			return len;
 		}
+		tx_v2 = 0;
+		#endif
+		*buf = (__xdata command_buffer_t *) rx_buffer[rx_lease_buffer];
+		return rx_buffer_len[rx_lease_buffer];
 	}
-	// No finished buffers found
 	return 0;
 }
 
-void uart1_put(char c) {
-  while (!UTX1IF);
-  U1DBUF = c;
-  UTX1IF = 0;
+// Give the leased message back. The buffer goes back to the receive
+// ISR once every message in it has been handled.
+void uart1_release_message(void) {
+	#ifdef UART1_ESP2
+	if (rx_buffer_v2[rx_lease_buffer]) {
+		rx_lease_offset += 1 + rx_buffer[rx_lease_buffer][rx_lease_offset];
+		if (rx_lease_offset < rx_buffer_len[rx_lease_buffer] - ESP2_CRC_SIZE) {
+			// More messages in this frame
+			EVENT_SET(EVENT_UART1);
+			return;
+		}
+	}
+	#endif
+	uart1_free_buffer();
+	#ifndef BOOTLOADER
+	if (rx_buffers_filled != rx_buffers_released) {
+		EVENT_SET(EVENT_UART1);
+	}
+	#endif
+}
+
+#ifdef BOOTLOADER
+// The bootloader has no TX interrupt so it writes straight
+// to the UART
+static void uart1_put(uint8_t c) {
+	while (!UTX1IF);
+	U1DBUF = c;
+	UTX1IF = 0;
+}
+#define uart1_tx_free() 0xff
+#define uart1_tx_wait(len)
+#define uart1_tx_start()
+#else
+static uint8_t uart1_tx_free(void) {
+	return tx_tail - tx_head - 1;
 }
 
-// TODO: use interrupts
-void uart1_send_message(const __xdata uint8_t *msg, uint8_t len) {
+// Only block if the ring is too full to take the whole frame
+static void uart1_tx_wait(uint8_t len) {
+	while (uart1_tx_free() < len);
+}
+
+static void uart1_put(uint8_t c) {
+	tx_buffer[tx_head] = c;
+	tx_head++;
+}
+
+// (Re)enable the TX interrupt. UTX1IF is left set while the
+// UART is idle so this fires straight away.
+#define uart1_tx_start() IEN2 |= IEN2_UTX1IE
+#endif
+
+#ifdef UART1_ESP2
+// Queue a message as a v2 frame (on its own) with a CRC
+static void uart1_send_frame_v2(uint8_t flags, const __xdata uint8_t *msg, uint8_t len) {
+	uint8_t frame_len;
+	uint16_t crc;
+
+	frame_len = ESP2_FLAGS_SIZE + 1 + len;
+	uart1_tx_wait(ESP2_HEADER_SIZE + frame_len + ESP2_CRC_SIZE);
+	uart1_put(ESP_START_BYTE_0);
+	uart1_put(ESP_START_BYTE_1_V2);
+	uart1_put(frame_len);
+	uart1_put(~frame_len);
+	crc16_start();
+	uart1_put(flags);
+	crc16_add(flags);
+	uart1_put(len);
+	crc16_add(len);
+	while (len--) {
+		crc16_add(*msg);
+		uart1_put(*(msg++));
+	}
+	crc = crc16_result();
+	uart1_put(crc & 0xff);
+	uart1_put(crc >> 8);
+	uart1_tx_start();
+}
+#endif
+
+// Queue a message for transmission. This only waits if the
+// transmit ring is full.
+void uart1_send_frame(uint8_t start_byte_1, const __xdata uint8_t *msg, uint8_t len) {
+	#ifdef UART1_ESP2
+	// Messages too long for a v2 frame still go out as v1
+	if (tx_v2 && len <= ESP2_MAX_MESSAGE) {
+		uart1_send_frame_v2((start_byte_1 == ESP_START_BYTE_1_LZ) ? ESP2_FLAG_LZ : 0,
+		                    msg, len);
+		return;
+	}
+	#endif
+	uart1_tx_wait(len + ESP_HEADER_SIZE);
 	// ESP header
 	uart1_put(ESP_START_BYTE_0);
-	uart1_put(ESP_START_BYTE_1);
+	uart1_put(start_byte_1);
 	uart1_put(len);
 	while (len--) {
 		uart1_put(*(msg++));
 	}
+	uart1_tx_start();
 }
 
-static __xdata command_t print_buf;
+void uart1_send_message(const __xdata uint8_t *msg, uint8_t len) {
+	uart1_send_frame(ESP_START_BYTE_1, msg, len);
+}
 
-// Send a string out the UART as an "ASCII" command
+// Send a string out the UART as an "ASCII" command. The message is
+// dropped rather than waiting for room in the transmit ring.
 void dprintf1(const char * msg) {
 	uint8_t len;
-	print_buf.header.hwid = hwid_flash;
-	print_buf.header.seqnum = 0;
-	print_buf.header.system = MSG_TYPE_RADIO_OUT;
-	print_buf.header.command = common_msg_ascii;
-	len = strcpylenx((__xdata void *) print_buf.data, (__xdata void *) msg);
-	uart1_send_message((__xdata void *) &print_buf, len + sizeof(print_buf.header));
-}
+	hwid_t hwid;
 
+	len = strlen(msg);
+	if (len > ESP_MAX_PAYLOAD - sizeof(command_header_t)) {
+		len = ESP_MAX_PAYLOAD - sizeof(command_header_t);
+	}
+	if (uart1_tx_free() < ESP_HEADER_SIZE + sizeof(command_header_t) + len) {
+		return;
+	}
+	uart1_put(ESP_START_BYTE_0);
+	uart1_put(ESP_START_BYTE_1);
+	uart1_put(sizeof(command_header_t) + len);
+	hwid = hwid_flash;
+	uart1_put(hwid & 0xff);
+	uart1_put(hwid >> 8);
+	uart1_put(0);  // seqnum
+	uart1_put(0);
+	uart1_put(MSG_TYPE_RADIO_OUT);
+	uart1_put(common_msg_ascii);
+	while (len--) {
+		uart1_put(*(msg++));
+	}
+	uart1_tx_start();
+}
 
 // UART ISR
 //
@@ -175,6 +411,7 @@ void dprintf1(const char * msg) {
 void uart1_rx_isr() __interrupt (URX1_VECTOR) __using (2) {
 	uint8_t c;
 
+	PROFILE_ISR_ENTER(PROFILE_ISR_UART1_RX);
 	c = U1DBUF;
 	switch (rx_esp_state) {
 		case wait_for_start0:
@@ -187,29 +424,72 @@ void uart1_rx_isr() __interrupt (URX1_VECTOR) __using (2) {
 		case wait_for_start1:
 			if (c == ESP_START_BYTE_1) {
 				rx_esp_state = wait_for_length;
+				#ifdef UART1_ESP2
+				rx_v2 = 0;
+			} else if (c == ESP_START_BYTE_1_V2) {
+				rx_esp_state = wait_for_length_v2;
+				rx_v2 = 1;
+				#endif
 			} else if (c == ESP_START_BYTE_0) {
 				rx_esp_state = wait_for_start1;
 			}
 			break;
 
+		#ifdef UART1_ESP2
+		case wait_for_length_v2:
+			// At least the flags and one message length
+			if (c > ESP2_MAX_FRAME || c < ESP2_FLAGS_SIZE + 1) {
+				rx_esp_state = (c == ESP_START_BYTE_0) ? wait_for_start1 : wait_for_start0;
+			} else {
+				rx_v2_len = c;
+				rx_esp_state = wait_for_length_check;
+			}
+			break;
+
+		case wait_for_length_check:
+			// A corrupted length is caught here rather than
+			// swallowing the frames that follow it
+			if (c != (uint8_t) ~rx_v2_len) {
+				rx_esp_state = (c == ESP_START_BYTE_0) ? wait_for_start1 : wait_for_start0;
+				break;
+			}
+			// The CRC is received (and checked later) with the rest
+			c = rx_v2_len + ESP2_CRC_SIZE;
+			// fall through
+		#endif
 		case wait_for_length:
 			if (c > ESP_MAX_PAYLOAD || c < 1) {
 				// Skip this packet if it is too long to handle
 				rx_esp_state = wait_for_start1;
 			} else {
-				// Find a free buffer
-				rx_active_buffer = 0;
-				while (rx_buffer_ready[rx_active_buffer]) {
-					rx_active_buffer++;
-				}
-				if (rx_active_buffer >= UART1_RX_BUFFERS) {
+				// The next buffer in the ring is free unless
+				// they are all waiting to be handled
+				if ((uint8_t) (rx_buffers_filled - rx_buffers_released) == UART1_RX_BUFFERS) {
 					// No free buffers, just skip this packet
-					rx_active_buffer = 0;
+					uart1_rx_dropped++;
+					TELEMETRY_SEQ_BUMP
 					rx_esp_state = wait_for_start0;
 				} else {
 					rx_buffer_len[rx_active_buffer] = c;
+					#ifdef UART1_ESP2
+					rx_buffer_v2[rx_active_buffer] = rx_v2;
+					#endif
 					rx_buffer_offset = 0;
 					rx_esp_state = receive_data;
+					#ifdef UART1_RX_DMA
+					// Let DMA take the payload and mute this ISR until
+					// uart1_dma_isr sees it complete. This writes the
+					// config directly since the dma_configure functions
+					// aren't reentrant.
+					dma_configs[dma_channel_uart1_rx].dest_h =
+						DMA_ADDR_HIGH(rx_buffer[rx_active_buffer]);
+					dma_configs[dma_channel_uart1_rx].dest_l =
+						DMA_ADDR_LOW(rx_buffer[rx_active_buffer]);
+					dma_configs[dma_channel_uart1_rx].len_h = DMA_VLEN_FIXED_USE_LEN;
+					dma_configs[dma_channel_uart1_rx].len_l = c;
+					dma_arm(dma_channel_uart1_rx);
+					URX1IE = 0;
+					#endif
 				}
 			}
 			break;
@@ -218,12 +498,82 @@ void uart1_rx_isr() __interrupt (URX1_VECTOR) __using (2) {
 			rx_buffer[rx_active_buffer][rx_buffer_offset++] = c;
 			if (rx_buffer_offset == rx_buffer_len[rx_active_buffer]) {
 				// This packet is done
-				rx_buffer_ready[rx_active_buffer] = 1;
+				if (++rx_active_buffer == UART1_RX_BUFFERS) {
+					rx_active_buffer = 0;
+				}
+				rx_buffers_filled++;
+				uart1_rts_update();
+				EVENT_SET(EVENT_UART1);
 				rx_esp_state = wait_for_start0;
 				uart1_rx_count++;
+				TELEMETRY_SEQ_BUMP
 			}
 			break;
 	}
+	PROFILE_ISR_EXIT(PROFILE_ISR_UART1_RX);
+}
+
+#ifdef UART1_RX_DMA
+// DMA completion ISR
+//
+// Only the UART1 RX channel has its IRQ mask set, so this runs when
+// a DMA payload transfer is complete. The last payload byte leaves
+// URX1IF set, so re-enabling the RX ISR feeds it that byte (or the
+// next frame's first byte if one has already arrived). The ESP
+// state machine just skips it while waiting for a start byte.
+//
+// This runs at UART1's priority (see uart1_init), so it uses UART1's
+// register bank rather than the one the lower priority ISRs use.
+void uart1_dma_isr() __interrupt (DMA_VECTOR) __using (2) {
+	PROFILE_ISR_ENTER(PROFILE_ISR_UART1_DMA);
+	DMAIF = 0;
+	if (DMAIRQ & (1<<dma_channel_uart1_rx)) {
+		DMAIRQ &= ~(1<<dma_channel_uart1_rx);
+		if (++rx_active_buffer == UART1_RX_BUFFERS) {
+			rx_active_buffer = 0;
+		}
+		rx_buffers_filled++;
+		uart1_rts_update();
+		EVENT_SET(EVENT_UART1);
+		rx_esp_state = wait_for_start0;
+		uart1_rx_count++;
+		TELEMETRY_SEQ_BUMP
+		URX1IE = 1;
+	}
+	PROFILE_ISR_EXIT(PROFILE_ISR_UART1_DMA);
+}
+#endif
+
+#ifndef BOOTLOADER
+// UART TX ISR
+//
+// Feeds the next byte from the transmit ring. This shares the
+// priority group (and so the register bank) of the RX ISR.
+// When the ring is empty (or CTS says the host can't take any
+// more) the interrupt is disabled but UTX1IF is left set so
+// that re-enabling it restarts transmission.
+void uart1_tx_isr() __interrupt (UTX1_VECTOR) __using (2) {
+	PROFILE_ISR_ENTER(PROFILE_ISR_UART1_TX);
+	if (tx_tail == tx_head) {
+		IEN2 &= ~IEN2_UTX1IE;
+		PROFILE_ISR_EXIT(PROFILE_ISR_UART1_TX);
+		return;
+	}
+	#if CONFIG_UART1_USE_CTS == 1
+	if (CONFIG_UART1_CTS_PIN == CTS_WAIT) {
+		// The host isn't ready. The timer tick restarts us
+		// once it is (see UART1_FLOW_TICK).
+		IEN2 &= ~IEN2_UTX1IE;
+		uart1_tx_cts_wait = 1;
+		PROFILE_ISR_EXIT(PROFILE_ISR_UART1_TX);
+		return;
+	}
+	#endif
+	UTX1IF = 0;
+	U1DBUF = tx_buffer[tx_tail];
+	tx_tail++;
+	PROFILE_ISR_EXIT(PROFILE_ISR_UART1_TX);
 }
+#endif
 
 #endif
@@ -19,6 +19,7 @@
 
 #include <cc1110.h>
 #include <stdint.h>
+#include "commands.h"
 
 #ifndef UART1_RX_BUFFERS
 // By default, UART1 is the "high speed" interface
@@ -32,14 +33,55 @@
 #endif
 
 void uart1_rx_isr() __interrupt (URX1_VECTOR) __using (2);
+#ifndef BOOTLOADER
+void uart1_tx_isr() __interrupt (UTX1_VECTOR) __using (2);
+#if CONFIG_UART1_RX_DMA == 1
+void uart1_dma_isr() __interrupt (DMA_VECTOR) __using (2);
+#endif
+#endif
 void uart1_init(void);
-uint8_t uart1_get_message(__xdata uint8_t *buf);
+uint8_t uart1_lease_message(__xdata command_buffer_t **buf);
+void uart1_release_message(void);
 void uart1_send_message(const __xdata uint8_t *msg, uint8_t len);
+void uart1_send_frame(uint8_t start_byte_1, const __xdata uint8_t *msg, uint8_t len);
 
 // TODO: better
 void dprintf1(const char *msg);
 // void dprintf2(char * msg, uint8_t val);
 
 extern volatile __data uint32_t uart1_rx_count;
+extern volatile __xdata uint32_t uart1_rx_dropped;
+
+#ifndef BOOTLOADER
+#if CONFIG_UART1_USE_FLOW_CTRL == 1
+extern volatile __xdata uint32_t uart1_rts_stall_ms;
+#endif
+#if CONFIG_UART1_USE_CTS == 1
+extern volatile __bit uart1_tx_cts_wait;
+#endif
+
+// Called from the Timer 1 ISR every ms milliseconds (1, or about 2.4
+// with TIMERS_TICKLESS) to count the time spent holding off the host
+// and to restart transmission once CTS clears
+#if CONFIG_UART1_USE_FLOW_CTRL == 1
+#define UART1_RTS_TICK(ms) \
+	if (CONFIG_UART1_FLOW_PIN == RTS_WAIT) { \
+		uart1_rts_stall_ms += (ms); \
+		TELEMETRY_SEQ_BUMP \
+	}
+#else
+#define UART1_RTS_TICK(ms)
+#endif
+#if CONFIG_UART1_USE_CTS == 1
+#define UART1_CTS_TICK \
+	if (uart1_tx_cts_wait && CONFIG_UART1_CTS_PIN == CTS_OK) { \
+		uart1_tx_cts_wait = 0; \
+		IEN2 |= IEN2_UTX1IE; \
+	}
+#else
+#define UART1_CTS_TICK
+#endif
+#define UART1_FLOW_TICK(ms) UART1_RTS_TICK(ms) UART1_CTS_TICK
+#endif
 
 #endif
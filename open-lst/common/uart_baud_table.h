@@ -0,0 +1,135 @@
+// OpenLST
+// Copyright (C) 2018 Planet Labs Inc.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// UART baud rate settings for each supported F_CLK
+// Generated by tools/gen_uart_baud_table.py - do not edit
+//
+// baud = (256 + BAUD_M) * 2 ^ BAUD_E / 2 ^ 28 * F_CLK
+// Rates with more than 1.5% error are left out.
+#ifndef _UART_BAUD_TABLE_H
+#define _UART_BAUD_TABLE_H
+
+#if F_CLK == 26000000
+#define UART_BAUD_M_2400 131  // 2399 baud (-0.04%)
+#define UART_BAUD_E_2400 6
+#define UART_BAUD_OK_2400 1
+#define UART_BAUD_M_4800 131  // 4798 baud (-0.04%)
+#define UART_BAUD_E_4800 7
+#define UART_BAUD_OK_4800 1
+#define UART_BAUD_M_9600 131  // 9596 baud (-0.04%)
+#define UART_BAUD_E_9600 8
+#define UART_BAUD_OK_9600 1
+#define UART_BAUD_M_14400 34  // 14381 baud (-0.13%)
+#define UART_BAUD_E_14400 9
+#define UART_BAUD_OK_14400 1
+#define UART_BAUD_M_19200 131  // 19192 baud (-0.04%)
+#define UART_BAUD_E_19200 9
+#define UART_BAUD_OK_19200 1
+#define UART_BAUD_M_28800 34  // 28763 baud (-0.13%)
+#define UART_BAUD_E_28800 10
+#define UART_BAUD_OK_28800 1
+#define UART_BAUD_M_38400 131  // 38383 baud (-0.04%)
+#define UART_BAUD_E_38400 10
+#define UART_BAUD_OK_38400 1
+#define UART_BAUD_M_57600 34  // 57526 baud (-0.13%)
+#define UART_BAUD_E_57600 11
+#define UART_BAUD_OK_57600 1
+#define UART_BAUD_M_76800 131  // 76767 baud (-0.04%)
+#define UART_BAUD_E_76800 11
+#define UART_BAUD_OK_76800 1
+#define UART_BAUD_M_115200 34  // 115051 baud (-0.13%)
+#define UART_BAUD_E_115200 12
+#define UART_BAUD_OK_115200 1
+#define UART_BAUD_M_230400 34  // 230103 baud (-0.13%)
+#define UART_BAUD_E_230400 13
+#define UART_BAUD_OK_230400 1
+#define UART_BAUD_M_250000 59  // 249939 baud (-0.02%)
+#define UART_BAUD_E_250000 13
+#define UART_BAUD_OK_250000 1
+#define UART_BAUD_M_460800 34  // 460205 baud (-0.13%)
+#define UART_BAUD_E_460800 14
+#define UART_BAUD_OK_460800 1
+#define UART_BAUD_M_500000 59  // 499878 baud (-0.02%)
+#define UART_BAUD_E_500000 14
+#define UART_BAUD_OK_500000 1
+#define UART_BAUD_M_921600 34  // 920410 baud (-0.13%)
+#define UART_BAUD_E_921600 15
+#define UART_BAUD_OK_921600 1
+#define UART_BAUD_M_1000000 59  // 999756 baud (-0.02%)
+#define UART_BAUD_E_1000000 15
+#define UART_BAUD_OK_1000000 1
+#elif F_CLK == 27000000
+#define UART_BAUD_M_2400 117  // 2401 baud (+0.05%)
+#define UART_BAUD_E_2400 6
+#define UART_BAUD_OK_2400 1
+#define UART_BAUD_M_4800 117  // 4802 baud (+0.05%)
+#define UART_BAUD_E_4800 7
+#define UART_BAUD_OK_4800 1
+#define UART_BAUD_M_9600 117  // 9604 baud (+0.05%)
+#define UART_BAUD_E_9600 8
+#define UART_BAUD_OK_9600 1
+#define UART_BAUD_M_14400 24  // 14420 baud (+0.14%)
+#define UART_BAUD_E_14400 9
+#define UART_BAUD_OK_14400 1
+#define UART_BAUD_M_19200 117  // 19209 baud (+0.05%)
+#define UART_BAUD_E_19200 9
+#define UART_BAUD_OK_19200 1
+#define UART_BAUD_M_28800 24  // 28839 baud (+0.14%)
+#define UART_BAUD_E_28800 10
+#define UART_BAUD_OK_28800 1
+#define UART_BAUD_M_38400 117  // 38418 baud (+0.05%)
+#define UART_BAUD_E_38400 10
+#define UART_BAUD_OK_38400 1
+#define UART_BAUD_M_57600 24  // 57678 baud (+0.14%)
+#define UART_BAUD_E_57600 11
+#define UART_BAUD_OK_57600 1
+#define UART_BAUD_M_76800 117  // 76836 baud (+0.05%)
+#define UART_BAUD_E_76800 11
+#define UART_BAUD_OK_76800 1
+#define UART_BAUD_M_115200 24  // 115356 baud (+0.14%)
+#define UART_BAUD_E_115200 12
+#define UART_BAUD_OK_115200 1
+#define UART_BAUD_M_230400 24  // 230713 baud (+0.14%)
+#define UART_BAUD_E_230400 13
+#define UART_BAUD_OK_230400 1
+#define UART_BAUD_M_250000 47  // 249664 baud (-0.13%)
+#define UART_BAUD_E_250000 13
+#define UART_BAUD_OK_250000 1
+#define UART_BAUD_M_460800 24  // 461426 baud (+0.14%)
+#define UART_BAUD_E_460800 14
+#define UART_BAUD_OK_460800 1
+#define UART_BAUD_M_500000 47  // 499329 baud (-0.13%)
+#define UART_BAUD_E_500000 14
+#define UART_BAUD_OK_500000 1
+#define UART_BAUD_M_921600 24  // 922852 baud (+0.14%)
+#define UART_BAUD_E_921600 15
+#define UART_BAUD_OK_921600 1
+#define UART_BAUD_M_1000000 47  // 998657 baud (-0.13%)
+#define UART_BAUD_E_1000000 15
+#define UART_BAUD_OK_1000000 1
+#endif
+
+// Look up the settings for a rate, e.g. UART_BAUD_M(921600). The rate
+// must be written as a plain decimal number. UART_BAUD_OK(rate) is 1
+// if the rate is in the table (and 0 in #if otherwise).
+#define _UART_BAUD_M(rate) UART_BAUD_M_ ## rate
+#define _UART_BAUD_E(rate) UART_BAUD_E_ ## rate
+#define _UART_BAUD_OK(rate) UART_BAUD_OK_ ## rate
+#define UART_BAUD_M(rate) _UART_BAUD_M(rate)
+#define UART_BAUD_E(rate) _UART_BAUD_E(rate)
+#define UART_BAUD_OK(rate) _UART_BAUD_OK(rate)
+
+#endif
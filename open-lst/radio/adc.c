@@ -18,24 +18,37 @@
 
 #include "adc.h"
 #include "board_defaults.h"
+#include "compiler_utils.h"
+#include "dma.h"
+#include "profile_isr.h"
+
+// AIN0-AIN7 are converted as one ADCCON2 sequence, and DMA moves each
+// result into adc_buffer as it completes. The temperature sensor and
+// VDD/3 can't be part of a sequence, so they follow as extra (ADCCON3)
+// conversions. The first is queued behind the sequence and the ADC
+// interrupt starts the second.
+#define ADC_SEQUENCE_CHANNELS 8
 
 volatile __bit adc_sample_ready;
-volatile int16_t adc_buffer[ADC_NUM_CHANNELS];
-static __code uint8_t adc_channels[ADC_NUM_CHANNELS] = {
-	ADCCON3_ECH_AIN0,
-	ADCCON3_ECH_AIN1,
-	ADCCON3_ECH_AIN2,
-	ADCCON3_ECH_AIN3,
-	ADCCON3_ECH_AIN4,
-	ADCCON3_ECH_AIN5,
-	ADCCON3_ECH_AIN6,
-	ADCCON3_ECH_AIN7,
+__xdata volatile uint16_t adc_buffer[ADC_NUM_CHANNELS];
+static __code uint8_t adc_extra_channels[ADC_NUM_CHANNELS - ADC_SEQUENCE_CHANNELS] = {
 	ADCCON3_ECH_TEMPERATURE,
 	ADCCON3_ECH_VDD_3
 };
 
 static volatile uint8_t adc_channel_index;
 
+// The sums are 16 bits, which holds 16 12 bit samples
+STATIC_ASSERT(adc_oversample_fits, ADC_OVERSAMPLE_SHIFT <= 4);
+// Each extra bit takes four times the sweeps
+STATIC_ASSERT(adc_extra_bits_supported, 2 * ADC_EXTRA_BITS <= ADC_OVERSAMPLE_SHIFT);
+#if ADC_OVERSAMPLE_SHIFT > 0
+static __xdata uint16_t adc_sum[ADC_NUM_CHANNELS];
+static __xdata uint16_t adc_min[ADC_NUM_CHANNELS];
+static __xdata uint16_t adc_max[ADC_NUM_CHANNELS];
+static __xdata uint8_t adc_sweeps;
+#endif
+
 void adc_init(void) {
 	// Enable ADC inputs
 	// Keep in mind this overrides any Px_DIR settings!
@@ -43,26 +56,99 @@ void adc_init(void) {
 	// Disable the interrupt and sample ready bit
 	ADCIE = 0;
 	adc_sample_ready = 0;
+	#if ADC_OVERSAMPLE_SHIFT > 0
+	adc_sweeps = 0;
+	#endif
 }
 
 void adc_start_sample(void) {
 	// Disable any ongoing samples by turning off the
-	// interrupt
+	// interrupt and the DMA channel
 	ADCIE = 0;
 	adc_sample_ready = 0;
-	// Start sampling at index 0 using the internal reference
+	dma_abort(dma_channel_adc);
+
+	// Each conversion in the sequence moves ADCL and ADCH
+	// as one word into the next slot of adc_buffer
+	dma_configure_transfer(
+		dma_channel_adc,
+		&X_ADCL,
+		(__xdata uint8_t *) adc_buffer,
+		DMA_WORDSIZE_16_BIT |
+		DMA_TMODE_SINGLE |
+		DMA_TRIG_ADC_CHALL,
+		DMA_SRCINC_ZERO |
+		DMA_DESTINC_ONE |
+		DMA_IRQMASK_DISABLE |
+		DMA_PRIORITY_NORMAL);
+	dma_configure_length(dma_channel_adc, DMA_VLEN_FIXED_USE_LEN,
+	                     ADC_SEQUENCE_CHANNELS);
+	dma_arm(dma_channel_adc);
+
+	// Sample AIN0 through AIN7 using the internal reference
 	// in 512 decimation rate mode (12 bit samples)
-	adc_channel_index = 0;
+	ADCCON2 = ADCCON2_SREF_INTERNAL_1_25V |
+	          ADCCON2_SDIV_512_DEC_12_BITS |
+	          ADCCON2_SCH_AIN7;
+	ADCCON1 = ADCCON1_ST |
+	          ADCCON1_STSEL_ADCCON1_ST |
+	          ADCCON1_RESERVED_DEFAULT;
+
+	// The first extra conversion waits for the sequence to finish
+	adc_channel_index = ADC_SEQUENCE_CHANNELS;
 	ADCCON3 = ADCCON3_EREF_INTERNAL_1_25V |
 	          ADCCON3_EDIV_512_DEC_12_BITS |
-	          adc_channels[adc_channel_index];
+	          adc_extra_channels[0];
 	// Clear the interrupt flag
 	ADCIF = 0;
-	// Enable the interrupt which will advance
-	// to the next sample
+	// Enable the interrupt, which only extra conversions raise
 	ADCIE = 1;
 }
 
+uint8_t adc_collect(__xdata int16_t *mean, __xdata int16_t *min, __xdata int16_t *max) {
+	uint8_t i;
+	uint16_t sample;
+
+	if (!adc_sample_ready) {
+		return 0;
+	}
+	adc_sample_ready = 0;
+	#if ADC_OVERSAMPLE_SHIFT == 0
+	for (i = 0; i < ADC_NUM_CHANNELS; i++) {
+		mean[i] = min[i] = max[i] = ADC_SAMPLE(adc_buffer[i]);
+	}
+	return 1;
+	#else
+	for (i = 0; i < ADC_NUM_CHANNELS; i++) {
+		sample = ADC_SAMPLE(adc_buffer[i]);
+		if (adc_sweeps == 0) {
+			adc_sum[i] = sample;
+			adc_min[i] = sample;
+			adc_max[i] = sample;
+			continue;
+		}
+		adc_sum[i] += sample;
+		if (sample < adc_min[i]) {
+			adc_min[i] = sample;
+		}
+		if (sample > adc_max[i]) {
+			adc_max[i] = sample;
+		}
+	}
+	if (++adc_sweeps < (1 << ADC_OVERSAMPLE_SHIFT)) {
+		return 0;
+	}
+	adc_sweeps = 0;
+	for (i = 0; i < ADC_NUM_CHANNELS; i++) {
+		// Decimate the sum to 12 bits plus the kept extra bits
+		mean[i] = adc_sum[i] >> (ADC_OVERSAMPLE_SHIFT - ADC_EXTRA_BITS);
+		min[i] = adc_min[i] << ADC_EXTRA_BITS;
+		max[i] = adc_max[i] << ADC_EXTRA_BITS;
+	}
+	return 1;
+	#endif
+}
+
 void adc_wait(void) {
 	// Wait for the sample ready bit to be set
 	// by the interrupt
@@ -70,8 +156,9 @@ void adc_wait(void) {
 }
 
 void adc_complete_isr() __interrupt (ADC_VECTOR) __using (1) {
-	// Read out the 12 bit sample
-	adc_buffer[adc_channel_index++] = (ADCH << 4) | (ADCL >> 4);
+	PROFILE_ISR_ENTER(PROFILE_ISR_ADC);
+	// Store the sample left aligned, as DMA does for the sequence
+	adc_buffer[adc_channel_index++] = (ADCH << 8) | ADCL;
 
 	if (adc_channel_index >= ADC_NUM_CHANNELS) {
 		// If we're done sampling all channels, set the sample
@@ -82,10 +169,11 @@ void adc_complete_isr() __interrupt (ADC_VECTOR) __using (1) {
 		// ADCCON3)
 		ADCIE = 0;
 	} else {
-		// Start the next sample using the internal reference
-		// in 512 decimation rate mode (12 bit samples)
+		// Start the next extra conversion using the internal
+		// reference in 512 decimation rate mode (12 bit samples)
 		ADCCON3 = ADCCON3_EREF_INTERNAL_1_25V |
 		          ADCCON3_EDIV_512_DEC_12_BITS |
-		          adc_channels[adc_channel_index];
+		          adc_extra_channels[adc_channel_index - ADC_SEQUENCE_CHANNELS];
 	}
+	PROFILE_ISR_EXIT(PROFILE_ISR_ADC);
 }
@@ -21,12 +21,20 @@
 
 #define ADC_NUM_CHANNELS 10
 
+// adc_buffer holds the results as read from ADCH:ADCL, with the 12 bit
+// sample in the top bits. This gives the sample.
+#define ADC_SAMPLE(raw) ((raw) >> 4)
+
 void adc_init(void);
 void adc_start_sample(void);
 void adc_wait(void);
 void adc_complete_isr() __interrupt (ADC_VECTOR) __using (1);
+// Fold a finished sweep into the running figures. Once a full period of
+// sweeps is in, stores the mean, min and max of each channel and
+// returns 1.
+uint8_t adc_collect(__xdata int16_t *mean, __xdata int16_t *min, __xdata int16_t *max);
 
 extern volatile __bit adc_sample_ready;
-extern volatile int16_t adc_buffer[ADC_NUM_CHANNELS];
+extern __xdata volatile uint16_t adc_buffer[ADC_NUM_CHANNELS];
 
 #endif
@@ -0,0 +1,307 @@
+// OpenLST
+// Copyright (C) 2018 Planet Labs Inc.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Authenticated command wrapper
+//
+// CCM is built from two passes through the AES coprocessor: CBC-MAC
+// for the tag (CBC_MAC mode with the final block run in CBC mode to
+// read out the MAC, as in the bootloader signature check) and CTR
+// keystream blocks produced one at a time in ECB mode. DMA channels
+// feed ENCDI and drain ENCDO so RF DMA keeps running on its own
+// channel while a frame is processed.
+
+#include <cc1110.h>
+#include "auth.h"
+#include "board_defaults.h"
+#include "cc1110_regs.h"
+#include "compiler_utils.h"
+#include "dma.h"
+#include "flash_constants.h"
+#include "hwid.h"
+#include "radio_commands.h"
+#include "stringx.h"
+#include "telemetry.h"
+
+#if AUTH_ENABLED == 1
+
+// CCM flags for the first MAC block (Adata, M = 8, L = 2) and for the
+// counter blocks (L = 2)
+#define CCM_FLAGS_B0   0x59
+#define CCM_FLAGS_CTR  0x01
+// The command header and counter are authenticated in the clear
+#define AUTH_AAD_SIZE  (sizeof(command_header_t) + AUTH_COUNTER_SIZE)
+
+STATIC_ASSERT(auth_aad_one_block, AUTH_AAD_SIZE + 2 <= AUTH_BLOCK_SIZE);
+STATIC_ASSERT(auth_key_in_storage, FLASH_AUTH_KEY + AUTH_KEY_SIZE - 1 <= FLASH_STORAGE_END);
+
+// Provisioned by flash_bootloader --auth-key. Erased flash (all 0xFF)
+// means no key has been loaded and every secure message is rejected.
+__code __at (FLASH_AUTH_KEY) uint8_t auth_key[AUTH_KEY_SIZE];
+
+static __xdata uint8_t auth_block[AUTH_BLOCK_SIZE];
+static __xdata uint8_t auth_out[AUTH_BLOCK_SIZE];
+static __xdata uint32_t auth_session;
+static __xdata uint32_t auth_counter;
+static __xdata uint32_t auth_last_counter;
+static __bit auth_session_valid;
+static uint8_t auth_dir;
+
+static void auth_aes_block(__xdata uint8_t *src, uint8_t enccs) {
+	dma_configure_source_addr(dma_channel_aes_in, src);
+	while (!(ENCCS & ENCCS_RDY));
+	dma_arm(dma_channel_aes_in);
+
+	S0CON &= ~(S0CON_ENCIF);
+	ENCCS = enccs | ENCCS_ST;
+	dma_wait(dma_channel_aes_in);
+	while (!(S0CON & S0CON_ENCIF));
+}
+
+// Run one block through the AES engine and wait for the result
+// to land in auth_out
+static void auth_aes_block_out(uint8_t enccs) {
+	dma_arm(dma_channel_aes_out);
+	auth_aes_block(auth_block, enccs);
+	dma_wait(dma_channel_aes_out);
+}
+
+// Set up the AES DMA channels and load the key. The channels are
+// configured every time since nothing else in the application owns
+// them.
+static void auth_aes_start(void) {
+	dma_configure_transfer(
+		dma_channel_aes_in,
+		auth_block,
+		&X_ENCDI,
+		DMA_WORDSIZE_8_BIT |
+		DMA_TMODE_SINGLE |
+		DMA_TRIG_ENC_DW,
+		DMA_SRCINC_ONE |
+		DMA_DESTINC_ZERO |
+		DMA_PRIORITY_HIGH);
+	dma_configure_length(
+		dma_channel_aes_in,
+		DMA_VLEN_FIXED_USE_LEN,
+		AUTH_BLOCK_SIZE);
+	dma_configure_transfer(
+		dma_channel_aes_out,
+		&X_ENCDO,
+		auth_out,
+		DMA_WORDSIZE_8_BIT |
+		DMA_TMODE_SINGLE |
+		DMA_TRIG_ENC_UP,
+		DMA_SRCINC_ZERO |
+		DMA_DESTINC_ONE |
+		DMA_PRIORITY_HIGH);
+	dma_configure_length(
+		dma_channel_aes_out,
+		DMA_VLEN_FIXED_USE_LEN,
+		AUTH_BLOCK_SIZE);
+
+	auth_aes_block((__xdata uint8_t *) auth_key,
+	               ENCCS_MODE_ECB | ENCCS_CMD_LOAD_KEY);
+}
+
+static __bit auth_key_provisioned(void) {
+	uint8_t i;
+	for (i = 0; i < AUTH_KEY_SIZE; i++) {
+		if (auth_key[i] != 0xff) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Fill auth_block with flags | nonce | 16 bit big endian tail, which
+// is B0 (tail = message length) or A_i (tail = i)
+static void auth_format_block(uint8_t flags, uint16_t tail) {
+	auth_block[0] = flags;
+	auth_block[1] = auth_dir;
+	auth_block[2] = hwid_flash & 0xff;
+	auth_block[3] = hwid_flash >> 8;
+	memcpyx((__xdata char *) &auth_block[4], (__xdata char *) &auth_session, sizeof(auth_session));
+	memcpyx((__xdata char *) &auth_block[8], (__xdata char *) &auth_counter, sizeof(auth_counter));
+	auth_block[12] = 0;
+	auth_block[13] = 0;
+	auth_block[14] = tail >> 8;
+	auth_block[15] = tail & 0xff;
+}
+
+// Generate keystream block S_i into auth_out
+static void auth_keystream(uint8_t i) {
+	auth_format_block(CCM_FLAGS_CTR, i);
+	auth_aes_block_out(ENCCS_MODE_ECB | ENCCS_CMD_ENCRYPT_BLOCK);
+}
+
+// Encrypt or decrypt (it's the same operation) len bytes in place
+static void auth_ctr(__xdata uint8_t *data, uint8_t len) {
+	uint8_t i, n;
+	uint8_t block;
+
+	for (block = 1; len; block++) {
+		auth_keystream(block);
+		n = len < AUTH_BLOCK_SIZE ? len : AUTH_BLOCK_SIZE;
+		for (i = 0; i < n; i++) {
+			data[i] ^= auth_out[i];
+		}
+		data += n;
+		len -= n;
+	}
+}
+
+// Compute the CBC-MAC over B0, the encoded AAD and the plaintext.
+// The tag T is left in auth_out.
+static void auth_mac(const __xdata uint8_t *aad, const __xdata uint8_t *data, uint8_t len) {
+	uint8_t n;
+
+	// Zero IV
+	memsetx((__xdata char *) auth_block, 0, sizeof(auth_block));
+	auth_aes_block(auth_block, ENCCS_MODE_CBC_MAC | ENCCS_CMD_LOAD_IV_NONCE);
+
+	auth_format_block(CCM_FLAGS_B0, len);
+	auth_aes_block(auth_block, ENCCS_MODE_CBC_MAC | ENCCS_CMD_ENCRYPT_BLOCK);
+
+	// The AAD is short enough to fit in one block after its
+	// two byte length. There is always at least one plaintext
+	// byte (the inner opcode) so this is never the last block.
+	memsetx((__xdata char *) auth_block, 0, sizeof(auth_block));
+	auth_block[1] = AUTH_AAD_SIZE;
+	memcpyx((__xdata char *) &auth_block[2], (__xdata char *) aad, AUTH_AAD_SIZE);
+	auth_aes_block(auth_block, ENCCS_MODE_CBC_MAC | ENCCS_CMD_ENCRYPT_BLOCK);
+
+	while (len) {
+		n = len < AUTH_BLOCK_SIZE ? len : AUTH_BLOCK_SIZE;
+		memsetx((__xdata char *) auth_block, 0, sizeof(auth_block));
+		memcpyx((__xdata char *) auth_block, (__xdata char *) data, n);
+		data += n;
+		len -= n;
+		if (len) {
+			auth_aes_block(auth_block, ENCCS_MODE_CBC_MAC | ENCCS_CMD_ENCRYPT_BLOCK);
+		} else {
+			// Run the final block in CBC mode to read out the MAC
+			auth_aes_block_out(ENCCS_MODE_CBC | ENCCS_CMD_ENCRYPT_BLOCK);
+		}
+	}
+}
+
+uint32_t auth_get_session(void) {
+	if (!auth_session_valid) {
+		// Mix the fast timer, the sleep timer (which runs from
+		// a separate RC oscillator), the receiver and the uptime
+		// through AES so the ID can't be predicted from outside
+		auth_aes_start();
+		memsetx((__xdata char *) auth_block, 0, sizeof(auth_block));
+		auth_block[0] = T1CNTL;
+		auth_block[1] = T1CNTH;
+		auth_block[2] = WORTIME0;
+		auth_block[3] = WORTIME1;
+		auth_block[4] = RSSI;
+		auth_block[5] = FREQEST;
+		memcpyx((__xdata char *) &auth_block[6], (__xdata char *) &telemetry->uptime,
+		        sizeof(telemetry->uptime));
+		memcpyx((__xdata char *) &auth_block[10], (__xdata char *) &telemetry->packets_good,
+		        sizeof(telemetry->packets_good));
+		auth_block[14] = T1CNTL;
+		auth_aes_block_out(ENCCS_MODE_ECB | ENCCS_CMD_ENCRYPT_BLOCK);
+		memcpyx((__xdata char *) &auth_session, (__xdata char *) auth_out, sizeof(auth_session));
+		auth_last_counter = 0;
+		auth_session_valid = 1;
+	}
+	return auth_session;
+}
+
+uint32_t auth_get_last_counter(void) {
+	return auth_last_counter;
+}
+
+uint8_t auth_unwrap(__xdata command_t *cmd, uint8_t len) {
+	uint8_t i;
+	uint8_t plain_len;
+	__xdata uint8_t *plain;
+	__xdata uint8_t *mic;
+
+	// Sessions only exist once the ground has asked for one and
+	// there must be room for at least the inner opcode
+	if (!auth_session_valid || !auth_key_provisioned() ||
+	    len < sizeof(cmd->header) + AUTH_OVERHEAD) {
+		return 0;
+	}
+	memcpyx((__xdata char *) &auth_counter, (__xdata char *) cmd->data, sizeof(auth_counter));
+	if (auth_counter <= auth_last_counter) {
+		return 0;
+	}
+
+	plain = &cmd->data[AUTH_COUNTER_SIZE];
+	plain_len = len - sizeof(cmd->header) - AUTH_COUNTER_SIZE - AUTH_MIC_SIZE;
+	mic = plain + plain_len;
+
+	auth_dir = AUTH_DIR_COMMAND;
+	auth_aes_start();
+	auth_ctr(plain, plain_len);
+	auth_mac((__xdata uint8_t *) cmd, plain, plain_len);
+	// The MIC is T ^ S_0, so after this it should equal S_0
+	for (i = 0; i < AUTH_MIC_SIZE; i++) {
+		mic[i] ^= auth_out[i];
+	}
+	auth_keystream(0);
+	if (memcmpx_ct((__xdata char *) mic, (__xdata char *) auth_out, AUTH_MIC_SIZE) != 0) {
+		return 0;
+	}
+	auth_last_counter = auth_counter;
+
+	// Replace the wrapper with the inner command
+	cmd->header.command = plain[0];
+	memcpyx((__xdata char *) cmd->data, (__xdata char *) &plain[1], plain_len - 1);
+	return sizeof(cmd->header) + plain_len - 1;
+}
+
+uint8_t auth_wrap(__xdata command_t *reply, uint8_t len) {
+	uint8_t i;
+	uint8_t plain_len;
+	__xdata uint8_t *plain;
+	__xdata uint8_t *mic;
+
+	if (len > sizeof(reply->header) + sizeof(reply->data) - AUTH_OVERHEAD) {
+		return 0;
+	}
+	plain = &reply->data[AUTH_COUNTER_SIZE];
+	plain_len = len - sizeof(reply->header) + 1;
+	mic = plain + plain_len;
+
+	// Make room for the counter and the inner opcode. The regions
+	// overlap so copy from the end.
+	for (i = plain_len - 1; i > 0; i--) {
+		plain[i] = reply->data[i - 1];
+	}
+	plain[0] = reply->header.command;
+	reply->header.command = radio_msg_secure;
+	// Replies reuse the command's counter with the direction
+	// flipped in the nonce
+	memcpyx((__xdata char *) reply->data, (__xdata char *) &auth_counter, sizeof(auth_counter));
+
+	auth_dir = AUTH_DIR_REPLY;
+	auth_aes_start();
+	auth_mac((__xdata uint8_t *) reply, plain, plain_len);
+	memcpyx((__xdata char *) mic, (__xdata char *) auth_out, AUTH_MIC_SIZE);
+	auth_keystream(0);
+	for (i = 0; i < AUTH_MIC_SIZE; i++) {
+		mic[i] ^= auth_out[i];
+	}
+	auth_ctr(plain, plain_len);
+	return len + AUTH_OVERHEAD;
+}
+
+#endif
@@ -0,0 +1,60 @@
+// OpenLST
+// Copyright (C) 2018 Planet Labs Inc.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef _AUTH_H
+#define _AUTH_H
+
+#include <stdint.h>
+#include "commands.h"
+
+// Authenticated command wrapper (AES-CCM, RFC 3610 with L = 2, M = 8)
+//
+// A radio_msg_secure message carries another command:
+//   counter (uint32, little endian)  - sent in the clear
+//   opcode + data                    - encrypted
+//   MIC (AUTH_MIC_SIZE bytes)        - encrypted CBC-MAC tag
+// The command header and counter are authenticated but not encrypted.
+// The 13 byte nonce is built from the direction, the radio HWID, the
+// session ID and the counter so it is never reused under one key.
+#define AUTH_KEY_SIZE      16
+#define AUTH_BLOCK_SIZE    16
+#define AUTH_COUNTER_SIZE  4
+#define AUTH_MIC_SIZE      8
+#define AUTH_OVERHEAD      (AUTH_COUNTER_SIZE + AUTH_MIC_SIZE + sizeof(radio_msg_no_t))
+// The longest reply payload that still fits once it is wrapped
+#define COMMAND_MAX_WRAPPED_DATA (COMMAND_MAX_DATA - AUTH_OVERHEAD)
+
+#define AUTH_DIR_COMMAND   0
+#define AUTH_DIR_REPLY     1
+
+// Return the session ID, choosing one on first use. It is fixed until
+// the next reboot so counters captured in an earlier session can not
+// be replayed.
+uint32_t auth_get_session(void);
+// The counter of the last command accepted this session (0 before the
+// first), so a new ground process can carry on from it
+uint32_t auth_get_last_counter(void);
+
+// Authenticate and decrypt a radio_msg_secure message in place,
+// leaving the inner command in cmd. Returns the new length, or 0 if
+// the message is malformed, replayed or fails authentication.
+uint8_t auth_unwrap(__xdata command_t *cmd, uint8_t len);
+
+// Wrap a reply to the last command accepted by auth_unwrap in place.
+// Returns the new length or 0 if it would not fit.
+uint8_t auth_wrap(__xdata command_t *reply, uint8_t len);
+
+#endif
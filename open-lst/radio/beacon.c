@@ -0,0 +1,154 @@
+// OpenLST
+// Copyright (C) 2018 Planet Labs Inc.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Periodic telemetry beacon
+
+#include "beacon.h"
+#include "board_defaults.h"
+#include "cc1110_regs.h"
+#include "events.h"
+#include "hwid.h"
+#include "input_handlers.h"
+#include "radio_commands.h"
+#include "schedule.h"
+#include "stringx.h"
+#include "timers.h"
+
+#if BEACON_ENABLED == 1
+
+// Longer waits are made of several timers
+#define BEACON_MAX_WAIT_MS 60000
+// How soon to try again when the radio is busy
+#define BEACON_RETRY_MS 100
+// Preamble, sync word, length, flags, HWID and CRC
+#define BEACON_RF_OVERHEAD 14
+// Long enough ago for any beacon, and where the count stops
+#define BEACON_LONG_AGO_MS 0x00ffffff
+
+static __xdata beacon_config_t beacon;
+static __xdata uint8_t beacon_timer;
+static __xdata uint16_t beacon_seqnum;
+static __xdata uint16_t beacon_random;
+// The timer running now, what is left of the wait after it, and the
+// time since the last RF beacon
+static __xdata uint16_t beacon_timer_ms;
+static __xdata uint32_t beacon_remaining_ms;
+static __xdata uint32_t beacon_since_rf_ms;
+
+static void beacon_run(uint8_t timer);
+
+static void beacon_wait(uint32_t ms) {
+	beacon_timer_ms = BEACON_MAX_WAIT_MS;
+	if (ms < BEACON_MAX_WAIT_MS) {
+		beacon_timer_ms = ms;
+	}
+	beacon_remaining_ms = ms - beacon_timer_ms;
+	beacon_timer = schedule_timer_start(beacon_timer_ms, 0, beacon_run);
+}
+
+// The next wait, with jitter so beacons from several radios drift
+// apart instead of colliding every time
+static void beacon_wait_interval(void) {
+	uint32_t ms;
+
+	ms = (uint32_t) beacon.interval * 1000;
+	if (beacon.jitter) {
+		// xorshift
+		beacon_random ^= beacon_random << 7;
+		beacon_random ^= beacon_random >> 9;
+		beacon_random ^= beacon_random << 8;
+		ms += beacon_random % ((uint32_t) beacon.jitter + 1);
+	}
+	beacon_wait(ms);
+}
+
+static void beacon_send(void) {
+	__xdata command_t *frame;
+	uint8_t len;
+	uint8_t outputs;
+
+	frame = input_beacon_buffer();
+	frame->header.hwid = hwid_flash;
+	frame->header.seqnum = beacon_seqnum++;
+	frame->header.system = MSG_TYPE_RADIO_OUT;
+	frame->header.command = radio_msg_beacon;
+	len = sizeof(frame->header) +
+	      telem_sel_encode_values(beacon.mask,
+	                              &((__xdata msg_data_t *) frame->data)->telem_sel);
+
+	outputs = beacon.outputs;
+	if (outputs & BEACON_OUTPUT_RF) {
+		// Leave RF out of this beacon if it would take more than
+		// the allowed share of the airtime since the last one
+		if ((uint32_t) (len + BEACON_RF_OVERHEAD) * BEACON_MS_PER_BYTE * 100 >
+		    beacon_since_rf_ms * BEACON_MAX_DUTY_PERCENT) {
+			outputs &= ~BEACON_OUTPUT_RF;
+		} else {
+			beacon_since_rf_ms = 0;
+		}
+	}
+	input_send_beacon(outputs, len);
+}
+
+static void beacon_run(uint8_t timer) {
+	(void) timer;
+	beacon_timer = SCHEDULE_TIMER_NONE;
+	if (beacon_since_rf_ms < BEACON_LONG_AGO_MS) {
+		beacon_since_rf_ms += beacon_timer_ms;
+	}
+	if (beacon_remaining_ms) {
+		beacon_wait(beacon_remaining_ms);
+		return;
+	}
+	// Don't transmit over a packet that is arriving, or ahead of
+	// the reply to one that is waiting to be handled
+	if ((beacon.outputs & BEACON_OUTPUT_RF) &&
+	    ((main_events & EVENT_RF) || (PKTSTATUS & PKTSTATUS_SFD))) {
+		beacon_wait(BEACON_RETRY_MS);
+		return;
+	}
+	beacon_send();
+	beacon_wait_interval();
+}
+
+void beacon_configure(const __xdata beacon_config_t *config) {
+	schedule_timer_cancel(beacon_timer);
+	beacon_timer = SCHEDULE_TIMER_NONE;
+	memcpyx((__xdata void *) &beacon, (__xdata void *) config, sizeof(beacon));
+	beacon_random ^= timer_ticks;
+	if (beacon_random == 0) {
+		beacon_random = 1;
+	}
+	if (beacon.interval) {
+		beacon_wait_interval();
+	}
+}
+
+void beacon_init(void) {
+	beacon_timer = SCHEDULE_TIMER_NONE;
+	beacon_seqnum = 0;
+	beacon_random = hwid_flash | 1;
+	beacon_since_rf_ms = BEACON_LONG_AGO_MS;
+	beacon.interval = BEACON_INTERVAL;
+	beacon.jitter = BEACON_JITTER_MS;
+	beacon.outputs = BEACON_OUTPUTS;
+	memsetx((__xdata void *) beacon.mask, 0xff, sizeof(beacon.mask));
+	if (beacon.interval) {
+		beacon_wait_interval();
+	}
+}
+
+#endif
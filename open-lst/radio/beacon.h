@@ -0,0 +1,41 @@
+// OpenLST
+// Copyright (C) 2018 Planet Labs Inc.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef _BEACON_H
+#define _BEACON_H
+
+#include <stdint.h>
+#include "telem_sel.h"
+
+// Where beacons go
+#define BEACON_OUTPUT_RF    (1<<0)
+#define BEACON_OUTPUT_UART0 (1<<1)
+#define BEACON_OUTPUT_UART1 (1<<2)
+
+typedef struct {
+	uint16_t interval;  // Seconds between beacons, 0 to stop
+	uint16_t jitter;  // Up to this many ms are added to each interval
+	uint8_t outputs;  // BEACON_OUTPUT_*
+	uint8_t mask[TELEM_SEL_MASK_SIZE];  // Fields, as for get_telem_sel
+} beacon_config_t;
+
+#if BEACON_ENABLED == 1
+void beacon_init(void);
+// Apply a new configuration and restart the beacon with it
+void beacon_configure(const __xdata beacon_config_t *config);
+#endif
+
+#endif
@@ -17,136 +17,607 @@
 #include "commands.h"
 #include "cc1110_regs.h"
 #include "board_defaults.h"
+#include "compiler_utils.h"
 #include "hwid.h"
+#include "input_handlers.h"
+#include "profile.h"
 #include "radio_commands.h"
 #include "radio.h"
 #include "schedule.h"
 #include "stringx.h"
+#include "timetag.h"
 #include "watchdog.h"
+#if AUTH_ENABLED == 1
+#include "auth.h"
+#endif
+#if BEACON_ENABLED == 1
+#include "beacon.h"
+#endif
 
 #ifdef CUSTOM_COMMANDS
 uint8_t custom_commands(const __xdata command_t *cmd, uint8_t len, __xdata command_t *reply);
 #endif
 
-uint8_t commands_handle_command(const __xdata command_t *cmd, uint8_t len, __xdata command_t *reply) {
-	uint8_t reply_length;
-	#if RADIO_RANGING_RESPONDER == 1
+// Board command handlers are declared from the same list that
+// builds their table
+#ifdef BOARD_COMMANDS
+#define COMMAND_ENTRY(handler, min_len, max_len, max_reply, flags) \
+	uint8_t handler(__xdata command_args_t *args);
+#define COMMAND_NONE
+BOARD_COMMANDS
+#undef COMMAND_ENTRY
+#undef COMMAND_NONE
+#endif
+
+// The first opcode of the board's command table
+#ifndef BOARD_COMMAND_FIRST
+#define BOARD_COMMAND_FIRST 0x40
+#endif
+
+static __xdata command_args_t command_args;
+#if AUTH_ENABLED == 1
+// Set while running a command (or batch) that arrived wrapped
+static __bit authenticated;
+#define COMMANDS_AUTHENTICATED authenticated
+#else
+#define COMMANDS_AUTHENTICATED 0
+#endif
+
+// The header bytes a batched sub-command or sub-reply borrows from the
+// bytes in front of its opcode
+#define BATCH_SUB_HEADER_SIZE (sizeof(command_header_t) - sizeof(radio_msg_no_t))
+static __xdata uint8_t batch_saved[BATCH_SUB_HEADER_SIZE];
+static __xdata radio_callsign_t olst_callsign;
+static __xdata uint8_t olst_callsign_len;
+
+static uint8_t command_ack(__xdata command_args_t *args) {
+	args->reply->header.command = common_msg_ack;
+	return 0;
+}
+
+static uint8_t command_reboot(__xdata command_args_t *args) {
+	__xdata msg_data_t *cmd_data;
+
+	cmd_data = (__xdata msg_data_t *) args->cmd->data;
+	// Postpone reboot by specified number of seconds
+	if (args->len < sizeof(cmd_data->reboot_postpone)) {
+		// If we get a reboot message without the param, reboot immediately
+		// (assume the value is 0)
+		args->reply->header.command = common_msg_ack;
+		watchdog_reboot_now();
+	} else if (schedule_postpone_reboot(cmd_data->reboot_postpone.postpone_sec) ==
+	           SCHEDULE_REBOOT_POSTPONED) {
+		args->reply->header.command = common_msg_ack;
+	}
+	return 0;
+}
+
+static uint8_t command_get_time(__xdata command_args_t *args) {
+	__xdata msg_data_t *reply_data;
+
+	// Nack if the time has not been set yet
+	if (!rtc_set) {
+		return 0;
+	}
+	reply_data = (__xdata msg_data_t *) args->reply->data;
+	args->reply->header.command = radio_msg_set_time;
+	timers_get_time(&reply_data->time);
+	return sizeof(reply_data->time);
+}
+
+static uint8_t command_set_time(__xdata command_args_t *args) {
+	// TODO: any limits on this?
+	args->reply->header.command = common_msg_ack;
+	timers_set_time(&((__xdata msg_data_t *) args->cmd->data)->time);
+	#if TIMETAG_ENTRIES > 0
+	timetag_rearm();
+	#endif
+	return 0;
+}
+
+static uint8_t command_get_telem(__xdata command_args_t *args) {
+	__xdata msg_data_t *reply_data;
+
+	reply_data = (__xdata msg_data_t *) args->reply->data;
+	args->reply->header.command = radio_msg_telem;
+	memcpyx(
+		(__xdata void *) &reply_data->telemetry,
+		(__xdata void *) telemetry,
+		sizeof(reply_data->telemetry));
+	return sizeof(reply_data->telemetry);
+}
+
+static uint8_t command_get_callsign(__xdata command_args_t *args) {
+	args->reply->header.command = radio_msg_callsign;
+	memcpyx((__xdata void *) args->reply->data,
+	        (__xdata void *) &olst_callsign,
+	        olst_callsign_len);
+	return olst_callsign_len;
+}
+
+static uint8_t command_set_callsign(__xdata command_args_t *args) {
+	args->reply->header.command = common_msg_ack;
+	memcpyx((__xdata void *) &olst_callsign,
+	        (__xdata void *) args->cmd->data,
+	        args->len);
+	olst_callsign_len = args->len;
+	return 0;
+}
+
+#if RADIO_RANGING_RESPONDER == 1
+static uint8_t command_ranging(__xdata command_args_t *args) {
 	uint8_t old_tx_mode;
+	__xdata msg_data_t *reply_data;
+
+	reply_data = (__xdata msg_data_t *) args->reply->data;
+	args->reply->header.command = radio_msg_ranging_ack;
+	// Ranging is never wrapped: the turnaround has to be
+	// fixed and short and the ack carries nothing secret
+	reply_data->ranging_ack.ack_type = RANGING_ACK_TYPE;
+	reply_data->ranging_ack.ack_version= RANGING_ACK_VERSION;
+	// TODO wait until timer edge
+
+	// Send this packet using the ranging radio mode
+	old_tx_mode = radio_mode_tx;
+	radio_mode_tx = RADIO_MODE_RANGING_TX;
+	radio_send_packet(args->reply,
+	                  sizeof(args->reply->header) + sizeof(reply_data->ranging_ack),
+	                  RF_TIMING_PRECISE,
+	                  RF_RANGING_UART ? FLAGS_UART1_SEL : FLAGS_UART0_SEL);
+	// Restore the radio settings and mute the normal response
+	radio_mode_tx = old_tx_mode;
+	return COMMAND_NO_REPLY;
+}
+#define RANGING_ENTRY COMMAND_ENTRY(command_ranging, 0, COMMAND_MAX_DATA, 0, \
+                                    COMMAND_FLAG_NO_BATCH)
+#else
+#define RANGING_ENTRY COMMAND_NONE
+#endif
+
+#if AUTH_ENABLED == 1
+static uint8_t command_get_auth_session(__xdata command_args_t *args) {
+	__xdata msg_data_t *reply_data;
+
+	reply_data = (__xdata msg_data_t *) args->reply->data;
+	args->reply->header.command = radio_msg_auth_session;
+	reply_data->auth_session.session = auth_get_session();
+	reply_data->auth_session.last_counter = auth_get_last_counter();
+	return sizeof(reply_data->auth_session);
+}
+#define AUTH_SESSION_ENTRY COMMAND_ENTRY(command_get_auth_session, 0, 0, \
+                                         sizeof(auth_session_t), 0)
+#else
+#define AUTH_SESSION_ENTRY COMMAND_NONE
+#endif
+
+#if PROFILE_ENABLED == 1
+static uint8_t command_get_profile(__xdata command_args_t *args) {
+	__xdata msg_data_t *reply_data;
+
+	reply_data = (__xdata msg_data_t *) args->reply->data;
+	args->reply->header.command = radio_msg_profile;
+	memcpyx((__xdata void *) &reply_data->profile,
+	        (__xdata void *) &profile,
+	        sizeof(reply_data->profile));
+	#if PROFILE_ISR_ENABLED == 1
+	// Holding off interrupts for the whole copy would take too long,
+	// so a figure caught mid update is off until the next get_profile
+	memcpyx((__xdata void *) (&reply_data->profile + 1),
+	        (__xdata void *) profile_isr,
+	        sizeof(profile_isr));
 	#endif
+	return PROFILE_REPLY_SIZE;
+}
+#define PROFILE_ENTRY COMMAND_ENTRY(command_get_profile, 0, 0, PROFILE_REPLY_SIZE, 0)
+STATIC_ASSERT(profile_fits, PROFILE_REPLY_SIZE <= COMMAND_MAX_DATA);
+#else
+#define PROFILE_ENTRY COMMAND_NONE
+#endif
+
+static uint8_t command_get_telem_sel(__xdata command_args_t *args) {
+	__xdata msg_data_t *cmd_data;
+	uint8_t ack;
+
+	cmd_data = (__xdata msg_data_t *) args->cmd->data;
+	ack = TELEM_SEL_ID_NONE;
+	if (args->len == sizeof(cmd_data->telem_sel_request)) {
+		ack = cmd_data->telem_sel_request.ack;
+	}
+	args->reply->header.command = radio_msg_telem_sel;
+	return telem_sel_encode(cmd_data->telem_sel_request.mask, ack,
+	                        &((__xdata msg_data_t *) args->reply->data)->telem_sel,
+	                        TELEM_SEL_MAX_REPLY);
+}
+
+#if BEACON_ENABLED == 1
+static uint8_t command_set_beacon(__xdata command_args_t *args) {
+	args->reply->header.command = common_msg_ack;
+	beacon_configure(&((__xdata msg_data_t *) args->cmd->data)->beacon_config);
+	return 0;
+}
+#define BEACON_ENTRY \
+	COMMAND_ENTRY(command_set_beacon, sizeof(beacon_config_t), \
+	              sizeof(beacon_config_t), 0, COMMAND_FLAG_AUTH)
+#else
+#define BEACON_ENTRY COMMAND_NONE
+#endif
+
+#if TELEM_HISTORY_ENTRIES > 0
+static uint8_t command_get_telem_history(__xdata command_args_t *args) {
 	__xdata msg_data_t *cmd_data;
 	__xdata msg_data_t *reply_data;
+	uint32_t to;
+
+	cmd_data = (__xdata msg_data_t *) args->cmd->data;
+	reply_data = (__xdata msg_data_t *) args->reply->data;
+	to = 0xffffffff;
+	if (args->len == sizeof(cmd_data->telem_history_range)) {
+		to = cmd_data->telem_history_range.to;
+	}
+	args->reply->header.command = radio_msg_telem_history;
+	return telem_history_read(cmd_data->telem_history_range.from, to,
+	                          reply_data->telem_history,
+	                          TELEM_HISTORY_PER_REPLY) * sizeof(telem_record_t);
+}
+#define TELEM_HISTORY_ENTRY \
+	COMMAND_ENTRY(command_get_telem_history, sizeof(uint32_t), \
+	              sizeof(telem_history_range_t), \
+	              TELEM_HISTORY_PER_REPLY * sizeof(telem_record_t), 0)
+#else
+#define TELEM_HISTORY_ENTRY COMMAND_NONE
+#endif
 
-	__xdata radio_callsign_t *olst_callsign;
-	__xdata radio_callsign_t olst_callsign_rx;
+#if TIMETAG_ENTRIES > 0
+static const __code command_entry_t *commands_lookup(uint8_t opcode);
+
+static uint8_t command_timetag_add(__xdata command_args_t *args) {
+	__xdata msg_data_t *cmd_data;
+	__xdata msg_data_t *reply_data;
+	const __code command_entry_t *entry;
+	uint8_t id;
+
+	cmd_data = (__xdata msg_data_t *) args->cmd->data;
+	reply_data = (__xdata msg_data_t *) args->reply->data;
+	// Nothing can be timed until the RTC is set, and queued commands
+	// can't queue more or run a batch. Anything that can't be batched
+	// (it answers out of band) can't be queued either.
+	if (!rtc_set || cmd_data->timetag_add.command[0] == radio_msg_timetag_add ||
+	    cmd_data->timetag_add.command[0] == radio_msg_batch) {
+		return 0;
+	}
+	entry = commands_lookup(cmd_data->timetag_add.command[0]);
+	if (entry && (entry->flags & COMMAND_FLAG_NO_BATCH)) {
+		return 0;
+	}
+	id = timetag_add(&cmd_data->timetag_add.at,
+	                 cmd_data->timetag_add.command,
+	                 args->len - sizeof(cmd_data->timetag_add.at),
+	                 args->cmd->header.seqnum,
+	                 input_source,
+	                 COMMANDS_AUTHENTICATED);
+	if (id == TIMETAG_NONE) {
+		return 0;
+	}
+	args->reply->header.command = radio_msg_timetag_id;
+	reply_data->timetag_id.id = id;
+	return sizeof(reply_data->timetag_id);
+}
+
+static uint8_t command_timetag_list(__xdata command_args_t *args) {
+	__xdata msg_data_t *reply_data;
+
+	reply_data = (__xdata msg_data_t *) args->reply->data;
+	args->reply->header.command = radio_msg_timetag_entries;
+	return timetag_list(reply_data->timetag_info) * sizeof(timetag_info_t);
+}
+
+static uint8_t command_timetag_cancel(__xdata command_args_t *args) {
+	if (timetag_cancel(((__xdata msg_data_t *) args->cmd->data)->timetag_id.id)) {
+		args->reply->header.command = common_msg_ack;
+	}
+	return 0;
+}
+
+STATIC_ASSERT(timetag_list_fits,
+              TIMETAG_ENTRIES * sizeof(timetag_info_t) <= COMMAND_MAX_DATA);
+#define TIMETAG_ENTRIES_ \
+	COMMAND_ENTRY(command_timetag_add, sizeof(timespec_t) + 1, \
+	              sizeof(timespec_t) + TIMETAG_MAX_COMMAND, sizeof(timetag_id_t), \
+	              COMMAND_FLAG_AUTH)                         /* 0x23 timetag_add */ \
+	COMMAND_NONE                                             /* 0x24 timetag_id */ \
+	COMMAND_ENTRY(command_timetag_list, 0, 0, \
+	              TIMETAG_ENTRIES * sizeof(timetag_info_t), 0) /* 0x25 timetag_list */ \
+	COMMAND_NONE                                             /* 0x26 timetag_entries */ \
+	COMMAND_ENTRY(command_timetag_cancel, sizeof(timetag_id_t), sizeof(timetag_id_t), 0, \
+	              COMMAND_FLAG_AUTH)                         /* 0x27 timetag_cancel */
+#else
+#define TIMETAG_ENTRIES_ \
+	COMMAND_NONE COMMAND_NONE COMMAND_NONE COMMAND_NONE COMMAND_NONE
+#endif
+
+// Built-in commands, one entry per opcode from RADIO_COMMAND_FIRST.
+// Opcodes that are only ever replies have no handler.
+#define RADIO_COMMAND_FIRST common_msg_ack
+#define RADIO_COMMANDS \
+	COMMAND_ENTRY(command_ack, 0, COMMAND_MAX_DATA, 0, 0)    /* 0x10 ack */ \
+	COMMAND_NONE                                             /* 0x11 ascii */ \
+	COMMAND_ENTRY(command_reboot, 0, sizeof(reboot_postpone_t), 0, \
+	              COMMAND_FLAG_AUTH)                         /* 0x12 reboot */ \
+	COMMAND_ENTRY(command_get_time, 0, 0, sizeof(timespec_t), \
+	              0)                                         /* 0x13 get_time */ \
+	COMMAND_ENTRY(command_set_time, sizeof(timespec_t), sizeof(timespec_t), 0, \
+	              COMMAND_FLAG_AUTH)                         /* 0x14 set_time */ \
+	RANGING_ENTRY                                            /* 0x15 ranging */ \
+	COMMAND_NONE                                             /* 0x16 ranging_ack */ \
+	COMMAND_ENTRY(command_get_telem, 0, 0, sizeof(telemetry_t), \
+	              0)                                         /* 0x17 get_telem */ \
+	COMMAND_NONE                                             /* 0x18 telem */ \
+	COMMAND_ENTRY(command_get_callsign, 0, 0, sizeof(radio_callsign_t), \
+	              0)                                         /* 0x19 get_callsign */ \
+	COMMAND_ENTRY(command_set_callsign, 0, sizeof(radio_callsign_t), 0, \
+	              COMMAND_FLAG_AUTH)                         /* 0x1a set_callsign */ \
+	COMMAND_NONE                                             /* 0x1b callsign */ \
+	COMMAND_NONE                                             /* 0x1c secure (unwrapped first) */ \
+	AUTH_SESSION_ENTRY                                       /* 0x1d get_auth_session */ \
+	COMMAND_NONE                                             /* 0x1e auth_session */ \
+	COMMAND_NONE                                             /* 0x1f batch (run separately) */ \
+	COMMAND_NONE                                             /* 0x20 batch_reply */ \
+	PROFILE_ENTRY                                            /* 0x21 get_profile */ \
+	COMMAND_NONE                                             /* 0x22 profile */ \
+	TIMETAG_ENTRIES_                                         /* 0x23-0x27 timetag */ \
+	TELEM_HISTORY_ENTRY                                      /* 0x28 get_telem_history */ \
+	COMMAND_NONE                                             /* 0x29 telem_history */ \
+	COMMAND_ENTRY(command_get_telem_sel, TELEM_SEL_MASK_SIZE, \
+	              sizeof(telem_sel_request_t), TELEM_SEL_MAX_REPLY, \
+	              0)                                         /* 0x2a get_telem_sel */ \
+	COMMAND_NONE                                             /* 0x2b telem_sel */ \
+	BEACON_ENTRY                                             /* 0x2c set_beacon */ \
+	COMMAND_NONE                                             /* 0x2d beacon */
+
+#define COMMAND_ENTRY(handler, min_len, max_len, max_reply, flags) \
+	{ handler, min_len, max_len, max_reply, flags },
+#define COMMAND_NONE { 0, 0, 0, 0, 0 },
+
+static __code const command_entry_t radio_command_table[] = {
+	RADIO_COMMANDS
+};
+#define RADIO_COMMAND_COUNT (sizeof(radio_command_table) / sizeof(radio_command_table[0]))
+
+#ifdef BOARD_COMMANDS
+static __code const command_entry_t board_command_table[] = {
+	BOARD_COMMANDS
+};
+#define BOARD_COMMAND_COUNT (sizeof(board_command_table) / sizeof(board_command_table[0]))
+#endif
+
+#undef COMMAND_ENTRY
+#undef COMMAND_NONE
+
+STATIC_ASSERT(radio_command_table_ordered,
+              RADIO_COMMAND_FIRST + RADIO_COMMAND_COUNT == radio_msg_beacon + 1);
+#ifdef BOARD_COMMANDS
+STATIC_ASSERT(board_commands_after_radio_commands,
+              BOARD_COMMAND_FIRST >= RADIO_COMMAND_FIRST + RADIO_COMMAND_COUNT);
+#endif
+
+static const __code command_entry_t *commands_lookup(uint8_t opcode) {
+	if (opcode >= RADIO_COMMAND_FIRST &&
+	    opcode < RADIO_COMMAND_FIRST + RADIO_COMMAND_COUNT) {
+		return &radio_command_table[opcode - RADIO_COMMAND_FIRST];
+	}
+	#ifdef BOARD_COMMANDS
+	if (opcode >= BOARD_COMMAND_FIRST &&
+	    opcode < BOARD_COMMAND_FIRST + BOARD_COMMAND_COUNT) {
+		return &board_command_table[opcode - BOARD_COMMAND_FIRST];
+	}
+	#endif
+	return 0;
+}
+
+// Run one command from the table and return the length of its reply
+// (including the header), or 0 if there is no reply
+static uint8_t commands_run(const __code command_entry_t *entry,
+                            const __xdata command_t *cmd, uint8_t len,
+                            __xdata command_t *reply) {
+	uint8_t reply_length;
 
 	// Initialize the reply header
 	reply->header.hwid = hwid_flash;
 	reply->header.seqnum = cmd->header.seqnum;
 	reply->header.system = MSG_TYPE_RADIO_OUT;
 
-	cmd_data = (__xdata msg_data_t *) cmd->data;
-	reply_data = (__xdata msg_data_t *) reply->data;
-
 	// Fallthrough case - use "nack" as the default response
 	reply->header.command = common_msg_nack;
 	reply_length = sizeof(reply->header);
 
-	switch (cmd->header.command) {
-		case common_msg_ack:
-			reply->header.command = common_msg_ack;
-			break;
+	if (!entry || !entry->handler) {
+		return reply_length;
+	}
+	command_args.cmd = cmd;
+	command_args.reply = reply;
+	command_args.len = len - sizeof(cmd->header);
+	// Malformed commands are nacked without running the handler,
+	// as are privileged commands that weren't authenticated
+	if (command_args.len < entry->min_len ||
+	    command_args.len > entry->max_len) {
+		return reply_length;
+	}
+	#if AUTH_ENABLED == 1
+	if ((entry->flags & COMMAND_FLAG_AUTH) && !authenticated) {
+		return reply_length;
+	}
+	#endif
+	len = entry->handler(&command_args);
+	if (len == COMMAND_NO_REPLY) {
+		return 0;
+	}
+	return reply_length + len;
+}
 
-		case common_msg_nack:
-			reply->header.command = common_msg_nack;
+// Run each [len][opcode data...] sub-command of a batch in order and
+// pack their replies the same way into one reply. There's no room for
+// a scratch buffer, so each sub-command is given a header in place by
+// overwriting the bytes before its opcode (the tail of the one before
+// it, which has already run), and each sub-reply is written in place
+// over the tail of the one before it, with those bytes put back after.
+// Processing stops at a malformed length or once the longest reply of
+// the next sub-command might not fit.
+static uint8_t commands_run_batch(__xdata command_t *cmd, uint8_t len,
+                                  __xdata command_t *reply) {
+	__xdata uint8_t *in_buf;
+	__xdata uint8_t *out_buf;
+	__xdata command_t *sub_cmd;
+	__xdata command_t *sub_reply;
+	const __code command_entry_t *entry;
+	uint8_t in;
+	uint8_t next_in;
+	uint8_t out;
+	uint8_t reply_max;
+	uint8_t out_max;
+	hwid_t hwid;
+	uint16_t seqnum;
+	uint8_t system;
+
+	in_buf = (__xdata uint8_t *) cmd;
+	out_buf = (__xdata uint8_t *) reply;
+	hwid = cmd->header.hwid;
+	seqnum = cmd->header.seqnum;
+	system = cmd->header.system;
+
+	out_max = sizeof(command_buffer_t);
+	#if AUTH_ENABLED == 1
+	// Leave room to wrap the whole reply
+	if (authenticated) {
+		out_max -= AUTH_OVERHEAD;
+	}
+	#endif
+
+	in = sizeof(cmd->header);
+	out = sizeof(reply->header);
+	while (in < len) {
+		next_in = in + 1 + in_buf[in];
+		if (in_buf[in] == 0 || next_in > len || next_in <= in) {
 			break;
+		}
+		in++;
 
-		case radio_msg_reboot:
-			// Postpone reboot by specified number of seconds
-			if (len < sizeof(cmd->header) + sizeof(cmd_data->reboot_postpone)) {
-				// If we get a reboot message without the param, reboot immediately
-				// (assume the value is 0)
-				reply->header.command = common_msg_ack;
-				watchdog_reboot_now();
-			} else {
-				if (schedule_postpone_reboot(cmd_data->reboot_postpone.postpone_sec) ==
-					SCHEDULE_REBOOT_POSTPONED) {
-					reply->header.command = common_msg_ack;
-				} else {
-					reply->header.command = common_msg_nack;
-				}
-			}
+		// Replies and commands that answer out of band (ranging)
+		// get a nack, as does anything not in the tables
+		entry = commands_lookup(in_buf[in]);
+		reply_max = 0;
+		if (entry && (entry->flags & COMMAND_FLAG_NO_BATCH)) {
+			entry = 0;
+		}
+		if (entry) {
+			reply_max = entry->max_reply;
+		}
+		if ((uint16_t) out + 1 + sizeof(radio_msg_no_t) + reply_max > out_max) {
 			break;
+		}
 
-		case radio_msg_get_time:
-			if (rtc_set) {
-				reply->header.command = radio_msg_set_time;
-				timers_get_time(&reply_data->time);
-				reply_length += sizeof(reply_data->time);
-			} else {
-				// Nack if the time has not been set yet
-				reply->header.command = common_msg_nack;
-			}
-		break;
-
-		case radio_msg_set_time:
-			// TODO: any limits on this?
-			reply->header.command = common_msg_ack;
-			timers_set_time(&cmd_data->time);
-		break;
-
-		case radio_msg_get_telem:
-			reply->header.command = radio_msg_telem;
-			memcpyx(
-				(__xdata void *) &reply_data->telemetry,
-				(__xdata void *) &telemetry,
-				sizeof(reply_data->telemetry));
-			reply_length += sizeof(reply_data->telemetry);
-		break;
-
-		case radio_msg_set_callsign:
-			reply->header.command = common_msg_ack;
-			olst_callsign = (__xdata radio_callsign_t *) cmd->data;
-
-			memsetx((__xdata char *) olst_callsign_rx, 0, sizeof(*olst_callsign));
-			memcpyx(	(__xdata void *) &olst_callsign_rx,
-				(__xdata void *) olst_callsign,
-				sizeof(*olst_callsign));
-		break;
-
-		case radio_msg_get_callsign:
-			reply->header.command = radio_msg_callsign;
-			olst_callsign = (__xdata radio_callsign_t *) reply->data;
-
-			memcpyx(	(__xdata void *) olst_callsign,
-				(__xdata void *) olst_callsign_rx,
-				sizeof(*olst_callsign));
-
-			reply_length += sizeof(*olst_callsign);
-		break;
-
-		#if RADIO_RANGING_RESPONDER == 1
-		case radio_msg_ranging:
-			reply->header.command = radio_msg_ranging_ack;
-			// TODO handle encryption
-			reply_data->ranging_ack.ack_type = RANGING_ACK_TYPE;
-			reply_data->ranging_ack.ack_version= RANGING_ACK_VERSION;
-			reply_length += sizeof(reply_data->ranging_ack);
-			// TODO wait until timer edge
-
-			// Send this packet using the ranging radio mode
-			old_tx_mode = radio_mode_tx;
-			radio_mode_tx = RADIO_MODE_RANGING_TX;
-			radio_send_packet(reply, reply_length, RF_TIMING_PRECISE, RF_RANGING_UART);
-			// Restore the radio settings and mute the normal response
-			radio_mode_tx = old_tx_mode;
-			reply_length = 0;
-		break;
-		#endif
+		sub_cmd = (__xdata command_t *) &in_buf[in - BATCH_SUB_HEADER_SIZE];
+		sub_cmd->header.hwid = hwid;
+		sub_cmd->header.seqnum = seqnum;
+		sub_cmd->header.system = system;
+		sub_reply = (__xdata command_t *) &out_buf[out + 1 - BATCH_SUB_HEADER_SIZE];
+		memcpyx((__xdata void *) batch_saved,
+		        (__xdata void *) sub_reply,
+		        BATCH_SUB_HEADER_SIZE);
+		reply_max = commands_run(entry, sub_cmd,
+		                         next_in - in + BATCH_SUB_HEADER_SIZE,
+		                         sub_reply);
+		// A sub-command that sends no reply still gets its slot, as
+		// a nack
+		if (reply_max == 0) {
+			sub_reply->header.command = common_msg_nack;
+			reply_max = sizeof(sub_reply->header);
+		}
+		reply_max -= BATCH_SUB_HEADER_SIZE;
+		// The borrowed bytes end with this sub-reply's length
+		memcpyx((__xdata void *) sub_reply,
+		        (__xdata void *) batch_saved,
+		        BATCH_SUB_HEADER_SIZE);
+		out_buf[out] = reply_max;
+		out += 1 + out_buf[out];
+		in = next_in;
+	}
+
+	reply->header.hwid = hwid_flash;
+	reply->header.seqnum = seqnum;
+	reply->header.system = MSG_TYPE_RADIO_OUT;
+	reply->header.command = radio_msg_batch_reply;
+	return out;
+}
 
+// Run an already unwrapped command (or batch) and wrap its reply
+// if it arrived authenticated. The reply header must be initialized.
+static uint8_t commands_dispatch(const __xdata command_t *cmd, uint8_t len, __xdata command_t *reply) {
+	uint8_t reply_length;
+	const __code command_entry_t *entry;
+
+	if (cmd->header.command == radio_msg_batch) {
+		// The batch shares the outer frame's authentication
+		reply_length = commands_run_batch((__xdata command_t *) cmd, len, reply);
+	} else {
+		entry = commands_lookup(cmd->header.command);
 		#ifdef CUSTOM_COMMANDS
-		default:
+		if (!entry || !entry->handler) {
 			reply_length = custom_commands(cmd, len, reply);
+		} else
 		#endif
+		reply_length = commands_run(entry, cmd, len, reply);
+	}
+
+	#if AUTH_ENABLED == 1
+	if (authenticated && reply_length) {
+		reply_length = auth_wrap(reply, reply_length);
+		if (reply_length == 0) {
+			reply->header.command = common_msg_nack;
+			reply_length = sizeof(reply->header);
+		}
 	}
+	#endif
 	return reply_length;
 }
+
+static void commands_init_reply(const __xdata command_t *cmd, __xdata command_t *reply) {
+	reply->header.hwid = hwid_flash;
+	reply->header.seqnum = cmd->header.seqnum;
+	reply->header.system = MSG_TYPE_RADIO_OUT;
+
+	// Fallthrough case - use "nack" as the default response
+	reply->header.command = common_msg_nack;
+}
+
+uint8_t commands_handle_command(const __xdata command_t *cmd, uint8_t len, __xdata command_t *reply) {
+	commands_init_reply(cmd, reply);
+
+	#if AUTH_ENABLED == 1
+	authenticated = 0;
+	if (cmd->header.command == radio_msg_secure) {
+		// Unwrap in place so the rest of the handler sees the
+		// inner command. Failures get the plain nack.
+		len = auth_unwrap((__xdata command_t *) cmd, len);
+		if (len == 0) {
+			return sizeof(reply->header);
+		}
+		authenticated = 1;
+	}
+	#endif
+
+	return commands_dispatch(cmd, len, reply);
+}
+
+#if TIMETAG_ENTRIES > 0
+// Run a command queued by timetag_add. It was already unwrapped (and
+// its authentication recorded) when it was queued.
+uint8_t commands_handle_deferred(__xdata command_t *cmd, uint8_t len, __xdata command_t *reply, uint8_t was_authenticated) {
+	commands_init_reply(cmd, reply);
+	#if AUTH_ENABLED == 1
+	authenticated = was_authenticated;
+	#else
+	(void) was_authenticated;
+	#endif
+	return commands_dispatch(cmd, len, reply);
+}
+#endif
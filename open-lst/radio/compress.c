@@ -0,0 +1,113 @@
+// OpenLST
+// Copyright (C) 2018 Planet Labs Inc.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// LZSS compression of forwarded payload frames
+//
+// The match search is a plain backwards scan of the window. Frames
+// are at most a few hundred bytes and the window is small, so this is
+// quick enough and needs no extra RAM for hash chains.
+
+#include "board_defaults.h"
+#include "compress.h"
+
+#if RF_COMPRESSION_ENABLED == 1
+
+static __xdata uint8_t *compress_out;
+static uint8_t __data compress_out_len;
+static uint8_t __data compress_out_max;
+static uint8_t __data compress_bit;
+
+// Append the low count bits of value to the output, MSB first.
+// Returns 0 if the output is full.
+static uint8_t compress_put_bits(uint16_t value, uint8_t count) {
+	uint16_t mask;
+	mask = 1 << (count - 1);
+	while (mask) {
+		if (compress_bit == 0) {
+			// Start a new output byte
+			if (compress_out_len == compress_out_max) {
+				return 0;
+			}
+			compress_out[compress_out_len++] = 0;
+			compress_bit = 0x80;
+		}
+		if (value & mask) {
+			compress_out[compress_out_len - 1] |= compress_bit;
+		}
+		compress_bit >>= 1;
+		mask >>= 1;
+	}
+	return 1;
+}
+
+uint8_t compress_message(const __xdata uint8_t *in, uint8_t len,
+                         __xdata uint8_t *out, uint8_t out_max) {
+	uint8_t i, j, k;
+	uint8_t start;
+	uint8_t max_len;
+	uint8_t best_len, best_offset;
+
+	if (out_max == 0) {
+		return 0;
+	}
+	compress_out = out;
+	compress_out_max = out_max;
+	compress_bit = 0;
+	// The uncompressed length comes first
+	compress_out[0] = len;
+	compress_out_len = 1;
+
+	i = 0;
+	while (i < len) {
+		// Find the longest match in the window, preferring the
+		// nearest one
+		best_len = 0;
+		best_offset = 0;
+		max_len = len - i;
+		if (max_len > COMPRESS_MAX_MATCH) {
+			max_len = COMPRESS_MAX_MATCH;
+		}
+		start = (i > COMPRESS_WINDOW) ? i - COMPRESS_WINDOW : 0;
+		for (j = i; j > start; ) {
+			j--;
+			for (k = 0; k < max_len && in[j + k] == in[i + k]; k++);
+			if (k > best_len) {
+				best_len = k;
+				best_offset = i - j;
+				if (k == max_len) {
+					break;
+				}
+			}
+		}
+
+		if (best_len >= COMPRESS_MIN_MATCH) {
+			if (!compress_put_bits(((uint16_t) (best_offset - 1) << COMPRESS_LENGTH_BITS) |
+			                       (best_len - COMPRESS_MIN_MATCH),
+			                       1 + COMPRESS_OFFSET_BITS + COMPRESS_LENGTH_BITS)) {
+				return 0;
+			}
+			i += best_len;
+		} else {
+			if (!compress_put_bits(0x100 | in[i], 9)) {
+				return 0;
+			}
+			i++;
+		}
+	}
+	return compress_out_len;
+}
+
+#endif
@@ -0,0 +1,41 @@
+// OpenLST
+// Copyright (C) 2018 Planet Labs Inc.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef _COMPRESS_H
+#define _COMPRESS_H
+
+#include <stdint.h>
+
+// LZSS (heatshrink-style) per-frame compression for forwarded payload
+// traffic. The compressed form starts with the uncompressed length
+// followed by a bitstream of tokens (MSB first):
+//   1 + 8 bits                      literal byte
+//   0 + OFFSET_BITS + LENGTH_BITS   copy (length + COMPRESS_MIN_MATCH)
+//                                   bytes from (offset + 1) bytes back
+// The window is the frame itself so no history is kept between frames.
+// tools/openlst_tools/compression.py implements the same format.
+#define COMPRESS_OFFSET_BITS 6
+#define COMPRESS_LENGTH_BITS 4
+#define COMPRESS_WINDOW      (1 << COMPRESS_OFFSET_BITS)
+#define COMPRESS_MIN_MATCH   2
+#define COMPRESS_MAX_MATCH   (COMPRESS_MIN_MATCH + (1 << COMPRESS_LENGTH_BITS) - 1)
+
+// Compress len bytes from in to out. Returns the compressed length,
+// or 0 if the result would not fit in out_max bytes.
+uint8_t compress_message(const __xdata uint8_t *in, uint8_t len,
+                         __xdata uint8_t *out, uint8_t out_max);
+
+#endif
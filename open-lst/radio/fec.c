@@ -0,0 +1,358 @@
+// OpenLST
+// Copyright (C) 2018 Planet Labs Inc.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Reed-Solomon encoder and decoder for the optional RF outer code
+//
+// The encoder appends RF_RS_PARITY_BYTES parity symbols to a block
+// of data and the decoder corrects up to RF_RS_PARITY_BYTES / 2
+// symbol errors in place (Berlekamp-Massey, Chien search and Forney).
+// Arithmetic is done in log ("index") form using lookup tables in
+// code space so that the only XRAM used is the decoder scratch space.
+
+#include "board_defaults.h"
+#include "compiler_utils.h"
+#include "fec.h"
+#include "stringx.h"
+
+#if RF_RS_ENABLED == 1
+
+#define RS_NN     255
+#define RS_A0     RS_NN  // log of zero
+#define RS_NROOTS RF_RS_PARITY_BYTES
+#define RS_FCR    112  // First consecutive root (CCSDS)
+#define RS_PRIM   11   // Primitive element (CCSDS)
+#define RS_IPRIM  116  // RS_PRIM * RS_IPRIM == 1 (mod 255)
+
+STATIC_ASSERT(rs_parity_even, RS_NROOTS % 2 == 0);
+STATIC_ASSERT(rs_parity_range, RS_NROOTS >= 2 && RS_NROOTS <= 32);
+STATIC_ASSERT(rs_iprim_inverse, (RS_PRIM * RS_IPRIM) % RS_NN == 1);
+
+// Powers of alpha in GF(2^8) with x^8 + x^7 + x^2 + x + 1
+static __code uint8_t rs_alpha_to[256] = {
+	0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x87, 0x89, 0x95, 0xad,
+	0xdd, 0x3d, 0x7a, 0xf4, 0x6f, 0xde, 0x3b, 0x76, 0xec, 0x5f, 0xbe, 0xfb,
+	0x71, 0xe2, 0x43, 0x86, 0x8b, 0x91, 0xa5, 0xcd, 0x1d, 0x3a, 0x74, 0xe8,
+	0x57, 0xae, 0xdb, 0x31, 0x62, 0xc4, 0x0f, 0x1e, 0x3c, 0x78, 0xf0, 0x67,
+	0xce, 0x1b, 0x36, 0x6c, 0xd8, 0x37, 0x6e, 0xdc, 0x3f, 0x7e, 0xfc, 0x7f,
+	0xfe, 0x7b, 0xf6, 0x6b, 0xd6, 0x2b, 0x56, 0xac, 0xdf, 0x39, 0x72, 0xe4,
+	0x4f, 0x9e, 0xbb, 0xf1, 0x65, 0xca, 0x13, 0x26, 0x4c, 0x98, 0xb7, 0xe9,
+	0x55, 0xaa, 0xd3, 0x21, 0x42, 0x84, 0x8f, 0x99, 0xb5, 0xed, 0x5d, 0xba,
+	0xf3, 0x61, 0xc2, 0x03, 0x06, 0x0c, 0x18, 0x30, 0x60, 0xc0, 0x07, 0x0e,
+	0x1c, 0x38, 0x70, 0xe0, 0x47, 0x8e, 0x9b, 0xb1, 0xe5, 0x4d, 0x9a, 0xb3,
+	0xe1, 0x45, 0x8a, 0x93, 0xa1, 0xc5, 0x0d, 0x1a, 0x34, 0x68, 0xd0, 0x27,
+	0x4e, 0x9c, 0xbf, 0xf9, 0x75, 0xea, 0x53, 0xa6, 0xcb, 0x11, 0x22, 0x44,
+	0x88, 0x97, 0xa9, 0xd5, 0x2d, 0x5a, 0xb4, 0xef, 0x59, 0xb2, 0xe3, 0x41,
+	0x82, 0x83, 0x81, 0x85, 0x8d, 0x9d, 0xbd, 0xfd, 0x7d, 0xfa, 0x73, 0xe6,
+	0x4b, 0x96, 0xab, 0xd1, 0x25, 0x4a, 0x94, 0xaf, 0xd9, 0x35, 0x6a, 0xd4,
+	0x2f, 0x5e, 0xbc, 0xff, 0x79, 0xf2, 0x63, 0xc6, 0x0b, 0x16, 0x2c, 0x58,
+	0xb0, 0xe7, 0x49, 0x92, 0xa3, 0xc1, 0x05, 0x0a, 0x14, 0x28, 0x50, 0xa0,
+	0xc7, 0x09, 0x12, 0x24, 0x48, 0x90, 0xa7, 0xc9, 0x15, 0x2a, 0x54, 0xa8,
+	0xd7, 0x29, 0x52, 0xa4, 0xcf, 0x19, 0x32, 0x64, 0xc8, 0x17, 0x2e, 0x5c,
+	0xb8, 0xf7, 0x69, 0xd2, 0x23, 0x46, 0x8c, 0x9f, 0xb9, 0xf5, 0x6d, 0xda,
+	0x33, 0x66, 0xcc, 0x1f, 0x3e, 0x7c, 0xf8, 0x77, 0xee, 0x5b, 0xb6, 0xeb,
+	0x51, 0xa2, 0xc3, 0x00
+};
+
+// Logarithms (index form), log(0) is represented by RS_A0
+static __code uint8_t rs_index_of[256] = {
+	0xff, 0x00, 0x01, 0x63, 0x02, 0xc6, 0x64, 0x6a, 0x03, 0xcd, 0xc7, 0xbc,
+	0x65, 0x7e, 0x6b, 0x2a, 0x04, 0x8d, 0xce, 0x4e, 0xc8, 0xd4, 0xbd, 0xe1,
+	0x66, 0xdd, 0x7f, 0x31, 0x6c, 0x20, 0x2b, 0xf3, 0x05, 0x57, 0x8e, 0xe8,
+	0xcf, 0xac, 0x4f, 0x83, 0xc9, 0xd9, 0xd5, 0x41, 0xbe, 0x94, 0xe2, 0xb4,
+	0x67, 0x27, 0xde, 0xf0, 0x80, 0xb1, 0x32, 0x35, 0x6d, 0x45, 0x21, 0x12,
+	0x2c, 0x0d, 0xf4, 0x38, 0x06, 0x9b, 0x58, 0x1a, 0x8f, 0x79, 0xe9, 0x70,
+	0xd0, 0xc2, 0xad, 0xa8, 0x50, 0x75, 0x84, 0x48, 0xca, 0xfc, 0xda, 0x8a,
+	0xd6, 0x54, 0x42, 0x24, 0xbf, 0x98, 0x95, 0xf9, 0xe3, 0x5e, 0xb5, 0x15,
+	0x68, 0x61, 0x28, 0xba, 0xdf, 0x4c, 0xf1, 0x2f, 0x81, 0xe6, 0xb2, 0x3f,
+	0x33, 0xee, 0x36, 0x10, 0x6e, 0x18, 0x46, 0xa6, 0x22, 0x88, 0x13, 0xf7,
+	0x2d, 0xb8, 0x0e, 0x3d, 0xf5, 0xa4, 0x39, 0x3b, 0x07, 0x9e, 0x9c, 0x9d,
+	0x59, 0x9f, 0x1b, 0x08, 0x90, 0x09, 0x7a, 0x1c, 0xea, 0xa0, 0x71, 0x5a,
+	0xd1, 0x1d, 0xc3, 0x7b, 0xae, 0x0a, 0xa9, 0x91, 0x51, 0x5b, 0x76, 0x72,
+	0x85, 0xa1, 0x49, 0xeb, 0xcb, 0x7c, 0xfd, 0xc4, 0xdb, 0x1e, 0x8b, 0xd2,
+	0xd7, 0x92, 0x55, 0xaa, 0x43, 0x0b, 0x25, 0xaf, 0xc0, 0x73, 0x99, 0x77,
+	0x96, 0x5c, 0xfa, 0x52, 0xe4, 0xec, 0x5f, 0x4a, 0xb6, 0xa2, 0x16, 0x86,
+	0x69, 0xc5, 0x62, 0xfe, 0x29, 0x7d, 0xbb, 0xcc, 0xe0, 0xd3, 0x4d, 0x8c,
+	0xf2, 0x1f, 0x30, 0xdc, 0x82, 0xab, 0xe7, 0x56, 0xb3, 0x93, 0x40, 0xd8,
+	0x34, 0xb0, 0xef, 0x26, 0x37, 0x0c, 0x11, 0x44, 0x6f, 0x78, 0x19, 0x9a,
+	0x47, 0x74, 0xa7, 0xc1, 0x23, 0x53, 0x89, 0xfb, 0x14, 0x5d, 0xf8, 0x97,
+	0x2e, 0x4b, 0xb9, 0x60, 0x0f, 0xed, 0x3e, 0xe5, 0xf6, 0x87, 0xa5, 0x17,
+	0x3a, 0xa3, 0x3c, 0xb7
+};
+
+// Generator polynomial coefficients in index form, built by fec_init()
+static __xdata uint8_t rs_genpoly[RS_NROOTS + 1];
+
+// Decoder scratch space
+static __xdata uint8_t rs_syndrome[RS_NROOTS];
+static __xdata uint8_t rs_lambda[RS_NROOTS + 1];
+static __xdata uint8_t rs_b[RS_NROOTS + 1];
+static __xdata uint8_t rs_t[RS_NROOTS + 1];
+static __xdata uint8_t rs_omega[RS_NROOTS + 1];
+static __xdata uint8_t rs_root[RS_NROOTS / 2];
+static __xdata uint8_t rs_loc[RS_NROOTS / 2];
+
+static uint8_t rs_modnn(uint16_t x) {
+	while (x >= RS_NN) {
+		x -= RS_NN;
+		x = (x >> 8) + (x & RS_NN);
+	}
+	return x;
+}
+
+void fec_init(void) {
+	uint8_t i, j;
+	uint8_t root;
+
+	rs_genpoly[0] = 1;
+	root = rs_modnn(RS_FCR * RS_PRIM);
+	for (i = 0; i < RS_NROOTS; i++) {
+		rs_genpoly[i + 1] = 1;
+		// Multiply rs_genpoly[] by (x + alpha^root)
+		for (j = i; j > 0; j--) {
+			if (rs_genpoly[j] != 0) {
+				rs_genpoly[j] = rs_genpoly[j - 1] ^
+					rs_alpha_to[rs_modnn(rs_index_of[rs_genpoly[j]] + root)];
+			} else {
+				rs_genpoly[j] = rs_genpoly[j - 1];
+			}
+		}
+		// rs_genpoly[0] can never be zero
+		rs_genpoly[0] = rs_alpha_to[rs_modnn(rs_index_of[rs_genpoly[0]] + root)];
+		root = rs_modnn(root + RS_PRIM);
+	}
+	// Keep the generator in index form for quicker encoding
+	for (i = 0; i <= RS_NROOTS; i++) {
+		rs_genpoly[i] = rs_index_of[rs_genpoly[i]];
+	}
+}
+
+void fec_rs_encode(const __xdata uint8_t *data, uint8_t len,
+                   __xdata uint8_t *parity) {
+	uint8_t i, j;
+	uint8_t feedback;
+
+	memsetx(parity, 0, RS_NROOTS);
+	for (i = 0; i < len; i++) {
+		feedback = rs_index_of[data[i] ^ parity[0]];
+		if (feedback != RS_A0) {
+			for (j = 1; j < RS_NROOTS; j++) {
+				parity[j] ^= rs_alpha_to[rs_modnn(feedback + rs_genpoly[RS_NROOTS - j])];
+			}
+		}
+		// Shift the parity register
+		for (j = 0; j < RS_NROOTS - 1; j++) {
+			parity[j] = parity[j + 1];
+		}
+		if (feedback != RS_A0) {
+			parity[RS_NROOTS - 1] = rs_alpha_to[rs_modnn(feedback + rs_genpoly[0])];
+		} else {
+			parity[RS_NROOTS - 1] = 0;
+		}
+	}
+}
+
+// Returns the number of corrected symbols, or -1 if the codeword
+// could not be corrected. The codeword is only modified if the
+// correction succeeds.
+int8_t fec_rs_decode(__xdata uint8_t *codeword, uint8_t len) {
+	uint8_t i, j, r;
+	uint8_t el;
+	uint8_t discr_r;
+	uint8_t deg_lambda, deg_omega;
+	uint8_t count;
+	uint8_t q, tmp;
+	uint8_t num1, num2, den;
+	uint8_t pad;
+	uint8_t loc;
+	uint16_t k;
+	uint16_t pos;
+	uint8_t syn_error;
+
+	if (len <= RS_NROOTS) {
+		return -1;
+	}
+	pad = RS_NN - len;
+
+	// Form the syndromes by evaluating the codeword at the roots
+	// of the generator polynomial
+	for (i = 0; i < RS_NROOTS; i++) {
+		rs_syndrome[i] = codeword[0];
+	}
+	for (j = 1; j < len; j++) {
+		for (i = 0; i < RS_NROOTS; i++) {
+			if (rs_syndrome[i] == 0) {
+				rs_syndrome[i] = codeword[j];
+			} else {
+				rs_syndrome[i] = codeword[j] ^
+					rs_alpha_to[rs_modnn(rs_index_of[rs_syndrome[i]] +
+					                     (uint16_t) (RS_FCR + i) * RS_PRIM)];
+			}
+		}
+	}
+	syn_error = 0;
+	for (i = 0; i < RS_NROOTS; i++) {
+		syn_error |= rs_syndrome[i];
+		rs_syndrome[i] = rs_index_of[rs_syndrome[i]];
+	}
+	if (!syn_error) {
+		// All syndromes are zero: the codeword is intact
+		return 0;
+	}
+
+	// Berlekamp-Massey: find the error locator polynomial lambda(x)
+	memsetx(rs_lambda, 0, sizeof(rs_lambda));
+	rs_lambda[0] = 1;
+	for (i = 0; i <= RS_NROOTS; i++) {
+		rs_b[i] = rs_index_of[rs_lambda[i]];
+	}
+	el = 0;
+	for (r = 1; r <= RS_NROOTS; r++) {
+		// Compute the discrepancy at the r-th step
+		discr_r = 0;
+		for (i = 0; i < r; i++) {
+			if (rs_lambda[i] != 0 && rs_syndrome[r - i - 1] != RS_A0) {
+				discr_r ^= rs_alpha_to[rs_modnn(rs_index_of[rs_lambda[i]] +
+				                                rs_syndrome[r - i - 1])];
+			}
+		}
+		discr_r = rs_index_of[discr_r];
+		if (discr_r == RS_A0) {
+			// b(x) <-- x * b(x)
+			for (i = RS_NROOTS; i > 0; i--) {
+				rs_b[i] = rs_b[i - 1];
+			}
+			rs_b[0] = RS_A0;
+		} else {
+			// t(x) <-- lambda(x) - discr_r * x * b(x)
+			rs_t[0] = rs_lambda[0];
+			for (i = 0; i < RS_NROOTS; i++) {
+				if (rs_b[i] != RS_A0) {
+					rs_t[i + 1] = rs_lambda[i + 1] ^
+						rs_alpha_to[rs_modnn(discr_r + rs_b[i])];
+				} else {
+					rs_t[i + 1] = rs_lambda[i + 1];
+				}
+			}
+			if (2 * el <= r - 1) {
+				el = r - el;
+				// b(x) <-- inv(discr_r) * lambda(x)
+				for (i = 0; i <= RS_NROOTS; i++) {
+					rs_b[i] = (rs_lambda[i] == 0) ? RS_A0 :
+						rs_modnn(rs_index_of[rs_lambda[i]] - discr_r + RS_NN);
+				}
+			} else {
+				// b(x) <-- x * b(x)
+				for (i = RS_NROOTS; i > 0; i--) {
+					rs_b[i] = rs_b[i - 1];
+				}
+				rs_b[0] = RS_A0;
+			}
+			memcpyx(rs_lambda, rs_t, sizeof(rs_lambda));
+		}
+	}
+
+	// Convert lambda to index form and find its degree
+	deg_lambda = 0;
+	for (i = 0; i <= RS_NROOTS; i++) {
+		rs_lambda[i] = rs_index_of[rs_lambda[i]];
+		if (rs_lambda[i] != RS_A0) {
+			deg_lambda = i;
+		}
+	}
+	if (deg_lambda == 0 || deg_lambda > RS_NROOTS / 2) {
+		return -1;
+	}
+
+	// Chien search: find the roots of lambda(x). The register
+	// rs_t[] is reused to hold lambda[j] * alpha^(i * j).
+	memcpyx(rs_t, rs_lambda, sizeof(rs_t));
+	count = 0;
+	k = RS_IPRIM - 1;
+	for (pos = 1; pos <= RS_NN; pos++) {
+		q = 1;  // lambda[0] is always 0 in index form
+		for (j = deg_lambda; j > 0; j--) {
+			if (rs_t[j] != RS_A0) {
+				rs_t[j] = rs_modnn(rs_t[j] + j);
+				q ^= rs_alpha_to[rs_t[j]];
+			}
+		}
+		if (q == 0) {
+			// Errors can't be located in the (zero) padding
+			if (k < pad) {
+				return -1;
+			}
+			rs_root[count] = pos;
+			rs_loc[count] = k;
+			if (++count == deg_lambda) {
+				break;
+			}
+		}
+		k = rs_modnn(k + RS_IPRIM);
+	}
+	if (count != deg_lambda) {
+		// The number of roots doesn't match the degree of lambda:
+		// there are more errors than can be corrected
+		return -1;
+	}
+
+	// Error evaluator omega(x) = s(x) * lambda(x) mod x^NROOTS
+	// in index form
+	deg_omega = deg_lambda - 1;
+	for (i = 0; i <= deg_omega; i++) {
+		tmp = 0;
+		for (j = 0; j <= i; j++) {
+			if (rs_syndrome[i - j] != RS_A0 && rs_lambda[j] != RS_A0) {
+				tmp ^= rs_alpha_to[rs_modnn(rs_syndrome[i - j] + rs_lambda[j])];
+			}
+		}
+		rs_omega[i] = rs_index_of[tmp];
+	}
+
+	// Forney algorithm: compute the error values. The codeword is
+	// only corrected once every error value checks out.
+	for (j = 0; j < count; j++) {
+		num1 = 0;
+		for (i = 0; i <= deg_omega; i++) {
+			if (rs_omega[i] != RS_A0) {
+				num1 ^= rs_alpha_to[rs_modnn(rs_omega[i] +
+				                             (uint16_t) i * rs_root[j])];
+			}
+		}
+		num2 = rs_alpha_to[rs_modnn((uint16_t) rs_root[j] * (RS_FCR - 1) + RS_NN)];
+		den = 0;
+		// lambda[i + 1] for even i is the formal derivative of lambda
+		for (i = 0; i <= deg_lambda - 1 && i < RS_NROOTS; i += 2) {
+			if (rs_lambda[i + 1] != RS_A0) {
+				den ^= rs_alpha_to[rs_modnn(rs_lambda[i + 1] +
+				                            (uint16_t) i * rs_root[j])];
+			}
+		}
+		if (den == 0 || num1 == 0) {
+			return -1;
+		}
+		// Keep the error value (index form) in the root slot,
+		// the root itself is no longer needed
+		rs_root[j] = rs_modnn((uint16_t) rs_index_of[num1] + rs_index_of[num2] +
+		                      RS_NN - rs_index_of[den]);
+	}
+	for (j = 0; j < count; j++) {
+		loc = rs_loc[j] - pad;
+		codeword[loc] ^= rs_alpha_to[rs_root[j]];
+	}
+	return count;
+}
+
+#endif
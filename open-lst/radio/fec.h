@@ -0,0 +1,34 @@
+// OpenLST
+// Copyright (C) 2018 Planet Labs Inc.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef _FEC_H
+#define _FEC_H
+
+#include <stdint.h>
+
+// Reed-Solomon outer code over GF(2^8) using the CCSDS field and
+// generator conventions (field polynomial 0x187, first consecutive
+// root 112, primitive element 11). Codewords are shortened from
+// RS(255, 255 - RF_RS_PARITY_BYTES) by treating the missing leading
+// symbols as zero, so any codeword length up to 255 works.
+#define RS_SYMBOLS_MAX 255
+
+void fec_init(void);
+void fec_rs_encode(const __xdata uint8_t *data, uint8_t len,
+                   __xdata uint8_t *parity);
+int8_t fec_rs_decode(__xdata uint8_t *codeword, uint8_t len);
+
+#endif
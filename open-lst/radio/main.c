@@ -17,18 +17,25 @@
 #include <stdint.h>
 #include <cc1110.h>
 #include "board_defaults.h"
+#include "cc1110_regs.h"
 #include "adc.h"
+#include "beacon.h"
 #include "clock.h"
+#include "compiler_utils.h"
 #include "commands.h"
 #include "dma.h"
+#include "events.h"
 #include "input_handlers.h"
 #include "interrupts.h"
+#include "memwatch.h"
+#include "profile.h"
 #include "schedule.h"
 #include "uart0.h"
 #include "uart1.h"
 #include "radio.h"
 #include "telemetry.h"
 #include "timers.h"
+#include "timetag.h"
 #include "watchdog.h"
 // User specified board setup
 #ifdef CUSTOM_BOARD_INIT
@@ -52,13 +59,88 @@
 
 uint32_t timeout = TIMEOUT;
 
+// Start with every handler due so they all run once after boot
+volatile __data uint8_t main_events = EVENT_ALL;
+
+// Passes that ended with the source's work left over
+__xdata uint32_t main_loop_starved[MAIN_LOOP_SOURCES];
+
+typedef struct {
+	void (*handler)(void);
+	uint8_t event;
+	uint8_t priority;  // Lower runs first
+	uint8_t budget;  // Calls per pass
+} main_loop_source_t;
+
+// In PROFILE_* order
+static __code const main_loop_source_t main_loop_sources[MAIN_LOOP_SOURCES] = {
+	{ schedule_handle_events, EVENT_TICK,
+	  MAIN_LOOP_PRIORITY_TICK, MAIN_LOOP_BUDGET_TICK },
+	{ input_handle_uart0_rx, EVENT_UART0,
+	  MAIN_LOOP_PRIORITY_UART0, MAIN_LOOP_BUDGET_UART0 },
+	{ input_handle_uart1_rx, EVENT_UART1,
+	  MAIN_LOOP_PRIORITY_UART1, MAIN_LOOP_BUDGET_UART1 },
+	{ input_handle_rf_rx, EVENT_RF,
+	  MAIN_LOOP_PRIORITY_RF, MAIN_LOOP_BUDGET_RF }
+};
+STATIC_ASSERT(main_loop_sources_in_profile_order,
+              PROFILE_SCHEDULE == 0 && PROFILE_UART0 == 1 &&
+              PROFILE_UART1 == 2 && PROFILE_RF == 3);
+
+// Run handlers until every source is either idle or out of budget.
+// The highest priority pending source is picked again after every
+// call (each handles a single message), so urgent work never waits
+// behind more than one call of a lower priority source, and the
+// budgets stop a busy source from shutting the others out.
+static void main_loop_pass(void) {
+	uint8_t i;
+	uint8_t next;
+	static __xdata uint8_t used[MAIN_LOOP_SOURCES];
+
+	for (i = 0; i < MAIN_LOOP_SOURCES; i++) {
+		used[i] = 0;
+	}
+	while (1) {
+		next = MAIN_LOOP_SOURCES;
+		for (i = 0; i < MAIN_LOOP_SOURCES; i++) {
+			if ((main_events & main_loop_sources[i].event) &&
+			    used[i] < main_loop_sources[i].budget &&
+			    (next == MAIN_LOOP_SOURCES ||
+			     main_loop_sources[i].priority < main_loop_sources[next].priority)) {
+				next = i;
+			}
+		}
+		if (next == MAIN_LOOP_SOURCES) {
+			break;
+		}
+		// Handlers put their event back if they leave work for
+		// the next call
+		__critical {
+			main_events &= ~main_loop_sources[next].event;
+		}
+		used[next]++;
+		PROFILE_CALL(next, main_loop_sources[next].handler());
+	}
+	for (i = 0; i < MAIN_LOOP_SOURCES; i++) {
+		if (main_events & main_loop_sources[i].event) {
+			main_loop_starved[i]++;
+		}
+	}
+}
+
 static void initialize(void) {
 	// Set up the watchdog reset timer for about 1 second
 	WATCHDOG_ENABLE;
 	WATCHDOG_CLEAR;
 
+	#if MEMWATCH_ENABLED == 1
+	memwatch_init();
+	#endif
 	clock_init();
 	timers_init();
+	#if PROFILE_ENABLED == 1
+	profile_init();
+	#endif
 	dma_init();
 	telemetry_init();
 	#ifdef CUSTOM_BOARD_INIT
@@ -71,8 +153,14 @@ static void initialize(void) {
 	INTERRUPT_GLOBAL_ENABLE;
 
 	adc_init();
+	#if TIMETAG_ENTRIES > 0
+	timetag_init();
+	#endif
 	schedule_init();
 	radio_init();
+	#if BEACON_ENABLED == 1
+	beacon_init();
+	#endif
 	#if CONFIG_CAPABLE_RF_RX == 1
 	radio_listen();
 	#endif
@@ -88,10 +176,17 @@ void main(void) {
 	dprintf1(BOOT_STRING(GIT_REV));
 	while (1) {
 		WATCHDOG_CLEAR;
-		schedule_handle_events();
-		input_handle_uart0_rx();
-		input_handle_uart1_rx();
-		input_handle_rf_rx();
+		main_loop_pass();
 
+		#if MAIN_LOOP_IDLE == 1
+		// Stop the CPU until the next interrupt. An event raised
+		// between the check and the idle waits for the next
+		// interrupt, which is at most the 1ms Timer 1 tick away (or
+		// with TIMERS_TICKLESS the next overflow, about 2.4ms).
+		if (!main_events) {
+			PCON |= PCON_IDLE;
+			PROFILE_WAKEUP
+		}
+		#endif
 	}
 }
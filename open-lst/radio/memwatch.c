@@ -0,0 +1,109 @@
+// OpenLST
+// Copyright (C) 2018 Planet Labs Inc.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Stack and XRAM high water marks
+
+#include <cc1110.h>
+#include "board_defaults.h"
+#include "memwatch.h"
+
+#if MEMWATCH_ENABLED == 1
+
+#define MEMWATCH_CANARY 0xa5
+// The stack grows up to the top of IRAM
+#define MEMWATCH_IRAM_END 0x100
+// Radio.mk passes in the XRAM it gives the linker
+#ifndef XRAM_LOC
+#define XRAM_LOC 0xf000
+#endif
+#ifndef XRAM_SIZE
+#define XRAM_SIZE 0x0d00
+#endif
+#define MEMWATCH_XRAM_END (XRAM_LOC + XRAM_SIZE)
+
+// The lowest canary byte in XRAM that hasn't been overwritten
+static __xdata uint16_t memwatch_xram_mark;
+
+// The ends of the linker's XRAM segments, which aren't C symbols
+static uint16_t memwatch_pseg_end(void) __naked {
+	__asm
+	mov	dptr, #(s_PSEG + l_PSEG)
+	ret
+	__endasm;
+}
+
+static uint16_t memwatch_xseg_end(void) __naked {
+	__asm
+	mov	dptr, #(s_XSEG + l_XSEG)
+	ret
+	__endasm;
+}
+
+static uint16_t memwatch_xiseg_end(void) __naked {
+	__asm
+	mov	dptr, #(s_XISEG + l_XISEG)
+	ret
+	__endasm;
+}
+
+void memwatch_init(void) {
+	uint16_t addr;
+	uint16_t end;
+
+	// An ISR can push above SP while this runs, but it pops again
+	// before we get back
+	for (addr = SP + 1; addr < MEMWATCH_IRAM_END; addr++) {
+		*((__idata uint8_t *) (uint8_t) addr) = MEMWATCH_CANARY;
+	}
+
+	addr = memwatch_pseg_end();
+	end = memwatch_xseg_end();
+	if (end > addr) {
+		addr = end;
+	}
+	end = memwatch_xiseg_end();
+	if (end > addr) {
+		addr = end;
+	}
+	memwatch_xram_mark = addr;
+	for (; addr < MEMWATCH_XRAM_END; addr++) {
+		*((__xdata uint8_t *) addr) = MEMWATCH_CANARY;
+	}
+}
+
+// Look down from the top for the deepest byte the stack reached
+uint8_t memwatch_stack_free(void) {
+	uint16_t addr;
+
+	addr = MEMWATCH_IRAM_END;
+	while (addr > SP + 1 &&
+	       *((__idata uint8_t *) (uint8_t) (addr - 1)) == MEMWATCH_CANARY) {
+		addr--;
+	}
+	return MEMWATCH_IRAM_END - addr;
+}
+
+// Anything overrunning the last variable writes upwards from the end
+// of the segments, so follow that edge up
+uint16_t memwatch_xram_free(void) {
+	while (memwatch_xram_mark < MEMWATCH_XRAM_END &&
+	       *((__xdata uint8_t *) memwatch_xram_mark) != MEMWATCH_CANARY) {
+		memwatch_xram_mark++;
+	}
+	return MEMWATCH_XRAM_END - memwatch_xram_mark;
+}
+
+#endif
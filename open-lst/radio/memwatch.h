@@ -0,0 +1,33 @@
+// OpenLST
+// Copyright (C) 2018 Planet Labs Inc.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef _MEMWATCH_H
+#define _MEMWATCH_H
+
+#include <stdint.h>
+
+#if MEMWATCH_ENABLED == 1
+// Fill the unused IRAM above the stack pointer and the XRAM above the
+// linker's segments with a canary. Call this early, before the stack
+// gets deep.
+void memwatch_init(void);
+// Bytes of IRAM stack that have never been used
+uint8_t memwatch_stack_free(void);
+// Bytes at the top of XRAM that nothing has written to
+uint16_t memwatch_xram_free(void);
+#endif
+
+#endif
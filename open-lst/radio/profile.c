@@ -0,0 +1,67 @@
+// OpenLST
+// Copyright (C) 2018 Planet Labs Inc.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// Main loop handler latency accounting
+
+#include "board_defaults.h"
+#include "cc1110_regs.h"
+#include "profile.h"
+#include "stringx.h"
+#include "timers.h"
+
+#if PROFILE_ENABLED == 1
+
+__xdata profile_t profile;
+__xdata uint32_t profile_call_started;
+#if PROFILE_ISR_ENABLED == 1
+__xdata profile_isr_t profile_isr[PROFILE_ISR_SITES];
+__xdata uint16_t profile_isr_started[PROFILE_ISR_SITES];
+#endif
+
+void profile_init(void) {
+	memsetx((__xdata void *) &profile, 0, sizeof(profile));
+	#if PROFILE_ISR_ENABLED == 1
+	memsetx((__xdata void *) profile_isr, 0, sizeof(profile_isr));
+	#endif
+}
+
+uint32_t profile_now(void) {
+	uint16_t ms;
+
+	ms = timers_get_ticks();
+	return (uint32_t) ms * T1_PERIOD + timers_fine;
+}
+
+void profile_add(uint8_t stage, uint32_t started) {
+	uint32_t elapsed;
+	__xdata profile_stage_t *s;
+
+	// timer_ticks wraps after about a minute, so work in the same
+	// modulus
+	elapsed = profile_now() - started;
+	if ((int32_t) elapsed < 0) {
+		elapsed += (uint32_t) 65536 * T1_PERIOD;
+	}
+	s = &profile.stage[stage];
+	s->calls++;
+	if (elapsed > s->max) {
+		s->max = elapsed;
+	}
+	s->avg = s->avg - (s->avg >> 4) + (elapsed >> 4);
+}
+
+#endif
@@ -0,0 +1,76 @@
+// OpenLST
+// Copyright (C) 2018 Planet Labs Inc.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include <stdint.h>
+#include "profile_isr.h"
+
+// Service time of each main loop handler (and of the timer callbacks
+// run by schedule_handle_events), in Timer 1 counts (F_CLK).
+// The average is a running average over about the last 16 calls.
+typedef struct {
+	uint32_t calls;
+	uint32_t max;
+	uint32_t avg;
+} profile_stage_t;
+
+#define PROFILE_SCHEDULE 0
+#define PROFILE_UART0    1
+#define PROFILE_UART1    2
+#define PROFILE_RF       3
+#define PROFILE_TIMERS   4
+#define PROFILE_STAGES   5
+
+typedef struct {
+	profile_stage_t stage[PROFILE_STAGES];
+	uint32_t wakeups;  // Main loop passes after idling
+} profile_t;
+
+// get_profile replies with profile_t, then profile_isr when
+// PROFILE_ISR_ENABLED is set
+#if PROFILE_ISR_ENABLED == 1
+#define PROFILE_REPLY_SIZE (sizeof(profile_t) + \
+                            sizeof(profile_isr_t) * PROFILE_ISR_SITES)
+#else
+#define PROFILE_REPLY_SIZE sizeof(profile_t)
+#endif
+
+#if PROFILE_ENABLED == 1
+extern __xdata profile_t profile;
+extern __xdata uint32_t profile_call_started;
+
+void profile_init(void);
+// Timer 1 counts since boot, modulo 65536ms
+uint32_t profile_now(void);
+// Account the time since started (from profile_now) to stage
+void profile_add(uint8_t stage, uint32_t started);
+
+// Run a main loop handler and account its time to stage
+#define PROFILE_CALL(stage, call) do { \
+		profile_call_started = profile_now(); \
+		call; \
+		profile_add(stage, profile_call_started); \
+	} while (0)
+#define PROFILE_WAKEUP profile.wakeups++;
+#else
+#define PROFILE_CALL(stage, call) call
+#define PROFILE_WAKEUP
+#endif
+
+#endif
@@ -20,6 +20,11 @@
 
 #include "timers.h"
 #include "telemetry.h"
+#include "profile.h"
+#include "telem_history.h"
+#include "telem_sel.h"
+#include "beacon.h"
+#include "timetag.h"
 
 typedef enum {
 	radio_msg_reboot       = 0x12,
@@ -31,7 +36,25 @@ typedef enum {
 	radio_msg_telem        = 0x18,
 	radio_msg_get_callsign = 0x19,
 	radio_msg_set_callsign = 0x1a,
-	radio_msg_callsign     = 0x1b
+	radio_msg_callsign     = 0x1b,
+	radio_msg_secure       = 0x1c,
+	radio_msg_get_auth_session = 0x1d,
+	radio_msg_auth_session = 0x1e,
+	radio_msg_batch        = 0x1f,
+	radio_msg_batch_reply  = 0x20,
+	radio_msg_get_profile  = 0x21,
+	radio_msg_profile      = 0x22,
+	radio_msg_timetag_add  = 0x23,
+	radio_msg_timetag_id   = 0x24,
+	radio_msg_timetag_list = 0x25,
+	radio_msg_timetag_entries = 0x26,
+	radio_msg_timetag_cancel = 0x27,
+	radio_msg_get_telem_history = 0x28,
+	radio_msg_telem_history = 0x29,
+	radio_msg_get_telem_sel = 0x2a,
+	radio_msg_telem_sel    = 0x2b,
+	radio_msg_set_beacon   = 0x2c,
+	radio_msg_beacon       = 0x2d
 } radio_msg_no;
 
 #define RANGING_ACK_TYPE 1
@@ -46,11 +69,40 @@ typedef struct {
 	uint32_t postpone_sec;
 } reboot_postpone_t;
 
+typedef struct {
+	uint32_t session;
+	uint32_t last_counter;  // Secure commands must use a higher counter
+} auth_session_t;
+
+typedef struct {
+	timespec_t at;
+	uint8_t command[1];  // Opcode then data
+} timetag_add_t;
+
+typedef struct {
+	uint8_t id;
+} timetag_id_t;
+
+typedef struct {
+	uint32_t from;  // Uptime, inclusive
+	uint32_t to;  // Optional, inclusive
+} telem_history_range_t;
+
 typedef union {
 	timespec_t time;
 	radio_ranging_ack_t ranging_ack;
 	reboot_postpone_t reboot_postpone;
 	telemetry_t telemetry;
+	auth_session_t auth_session;
+	profile_t profile;
+	timetag_add_t timetag_add;
+	timetag_id_t timetag_id;
+	timetag_info_t timetag_info[1];  // As many as are queued
+	telem_history_range_t telem_history_range;
+	telem_record_t telem_history[1];  // As many as fit
+	telem_sel_request_t telem_sel_request;
+	telem_sel_reply_t telem_sel;
+	beacon_config_t beacon_config;
 	uint8_t data[1];
 } msg_data_t;
 
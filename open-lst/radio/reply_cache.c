@@ -0,0 +1,122 @@
+// OpenLST
+// Copyright (C) 2018 Planet Labs Inc.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// LRU cache of replies to recent RF commands
+
+#include "board_defaults.h"
+#include "crc16.h"
+#include "reply_cache.h"
+#include "stringx.h"
+#include "timers.h"
+
+#if REPLY_CACHE_ENTRIES > 0
+
+typedef struct {
+	hwid_t hwid;
+	uint16_t seqnum;
+	uint16_t crc;
+	radio_msg_no_t command;
+} reply_cache_key_t;
+
+typedef struct {
+	reply_cache_key_t key;
+	uint16_t stored;  // Low bits of uptime when stored
+	uint8_t age;  // Lookups since last used, for eviction
+	uint8_t len;  // 0 when empty
+	uint8_t reply[REPLY_CACHE_MAX_REPLY];
+} reply_cache_entry_t;
+
+static __xdata reply_cache_entry_t reply_cache[REPLY_CACHE_ENTRIES];
+static __xdata reply_cache_key_t reply_cache_key;
+__xdata uint32_t reply_cache_hits;
+
+// The Timer 1 ISR updates uptime, so copy it with that held off
+static uint16_t reply_cache_now(void) {
+	uint16_t now;
+
+	TIMER_INTERRUPTS_DISABLE;
+	now = uptime;
+	TIMER_INTERRUPTS_ENABLE;
+	return now;
+}
+
+uint8_t reply_cache_lookup(const __xdata command_t *cmd, uint8_t len,
+                           __xdata command_t *reply) {
+	uint8_t i;
+	uint8_t found;
+	uint16_t now;
+	__xdata reply_cache_entry_t *entry;
+
+	reply_cache_key.hwid = cmd->header.hwid;
+	reply_cache_key.seqnum = cmd->header.seqnum;
+	reply_cache_key.command = cmd->header.command;
+	reply_cache_key.crc = crc16((__xdata uint8_t *) cmd, len);
+
+	now = reply_cache_now();
+	found = REPLY_CACHE_ENTRIES;
+	for (i = 0; i < REPLY_CACHE_ENTRIES; i++) {
+		entry = &reply_cache[i];
+		if (entry->age != 0xff) {
+			entry->age++;
+		}
+		// Stale entries are dropped so a restarted ground tool
+		// reusing old seqnums is never answered from the cache
+		if (entry->len &&
+		    (uint16_t) (now - entry->stored) >= REPLY_CACHE_TTL) {
+			entry->len = 0;
+		}
+		if (entry->len &&
+		    memcmpx((__xdata char *) &entry->key,
+		            (__xdata char *) &reply_cache_key,
+		            sizeof(reply_cache_key)) == 0) {
+			found = i;
+		}
+	}
+	if (found == REPLY_CACHE_ENTRIES) {
+		return 0;
+	}
+	entry = &reply_cache[found];
+	entry->age = 0;
+	reply_cache_hits++;
+	memcpyx((__xdata void *) reply, (__xdata void *) entry->reply, entry->len);
+	return entry->len;
+}
+
+void reply_cache_store(const __xdata command_t *reply, uint8_t len) {
+	uint8_t i;
+	__xdata reply_cache_entry_t *entry;
+
+	if (len == 0 || len > REPLY_CACHE_MAX_REPLY) {
+		return;
+	}
+	// Replace an empty entry or else the least recently used one
+	entry = &reply_cache[0];
+	for (i = 1; i < REPLY_CACHE_ENTRIES && entry->len; i++) {
+		if (!reply_cache[i].len || reply_cache[i].age > entry->age) {
+			entry = &reply_cache[i];
+		}
+	}
+	memcpyx((__xdata void *) &entry->key,
+	        (__xdata void *) &reply_cache_key,
+	        sizeof(reply_cache_key));
+	memcpyx((__xdata void *) entry->reply, (__xdata void *) reply, len);
+	entry->stored = reply_cache_now();
+	entry->age = 0;
+	entry->len = len;
+}
+
+#endif
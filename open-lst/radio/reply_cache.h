@@ -0,0 +1,41 @@
+// OpenLST
+// Copyright (C) 2018 Planet Labs Inc.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef _REPLY_CACHE_H
+#define _REPLY_CACHE_H
+
+#include <stdint.h>
+#include "commands.h"
+
+// Recent replies keyed by the addressed HWID, seqnum, opcode and a
+// CRC of the whole command. Ground tools resend a command with the
+// same seqnum when its reply is lost, so a match within
+// REPLY_CACHE_TTL seconds is answered from here instead of running
+// the command again. Only replies up to REPLY_CACHE_MAX_REPLY bytes
+// are kept; longer ones (like telemetry) come from commands that are
+// safe to run twice.
+
+// Return the cached reply to cmd in reply and its length, or 0 if
+// there isn't one. The key is kept for reply_cache_store.
+uint8_t reply_cache_lookup(const __xdata command_t *cmd, uint8_t len,
+                           __xdata command_t *reply);
+// Cache the reply to the command last passed to reply_cache_lookup
+void reply_cache_store(const __xdata command_t *reply, uint8_t len);
+
+extern __xdata uint32_t reply_cache_hits;
+
+#endif
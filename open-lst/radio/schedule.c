@@ -14,24 +14,250 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+
 // Handle scheduled events like reboots and security leases
 
 #include "schedule.h"
 #include "board_defaults.h"
 #include "adc.h"
+#include "compiler_utils.h"
+#include "profile.h"
 #include "timers.h"
 #include "radio.h"
 #include "telemetry.h"
 #include "watchdog.h"
 
+// 100ms
+#define SCHEDULE_SLOW_PERIOD 100
+
+// Timers not in a wheel list are on the free list
+#define SCHEDULE_FREE 0xfe
+
+typedef struct {
+	schedule_callback_t callback;
+	uint32_t expires;  // In wheel time
+	uint16_t period;  // 0 for one-shot timers
+	uint8_t next;
+	uint8_t prev;
+	uint8_t list;  // Index into schedule_wheel, or SCHEDULE_FREE
+} schedule_timer_t;
+
+STATIC_ASSERT(schedule_timer_pool_size, SCHEDULE_TIMERS < SCHEDULE_FREE);
+
 __xdata uint32_t auto_reboot;
 
+static __xdata schedule_timer_t schedule_timers[SCHEDULE_TIMERS];
+// List heads, the first level then the second
+static __xdata uint8_t schedule_wheel[2 * SCHEDULE_WHEEL_SLOTS];
+static __xdata uint8_t schedule_free;
+// Milliseconds handled so far
+static __xdata uint32_t schedule_now;
+static __xdata uint16_t schedule_last_tick;
+static __bit schedule_dispatching;
+
+static void schedule_unlink(uint8_t t) {
+	__xdata schedule_timer_t *timer;
+
+	timer = &schedule_timers[t];
+	if (timer->prev == SCHEDULE_TIMER_NONE) {
+		schedule_wheel[timer->list] = timer->next;
+	} else {
+		schedule_timers[timer->prev].next = timer->next;
+	}
+	if (timer->next != SCHEDULE_TIMER_NONE) {
+		schedule_timers[timer->next].prev = timer->prev;
+	}
+}
+
+// Put a timer in the slot for its expiry time
+static void schedule_place(uint8_t t) {
+	__xdata schedule_timer_t *timer;
+	uint32_t delta;
+	uint8_t list;
+
+	timer = &schedule_timers[t];
+	delta = timer->expires - schedule_now;
+	if (delta < SCHEDULE_WHEEL_SLOTS) {
+		list = timer->expires & SCHEDULE_WHEEL_MASK;
+	} else if (delta < SCHEDULE_WHEEL_SLOTS * SCHEDULE_WHEEL_SLOTS) {
+		list = SCHEDULE_WHEEL_SLOTS +
+		       ((timer->expires >> SCHEDULE_WHEEL_BITS) & SCHEDULE_WHEEL_MASK);
+	} else {
+		// Too far out, wait in the last slot to come around
+		list = SCHEDULE_WHEEL_SLOTS +
+		       (((schedule_now >> SCHEDULE_WHEEL_BITS) - 1) & SCHEDULE_WHEEL_MASK);
+	}
+	timer->list = list;
+	timer->prev = SCHEDULE_TIMER_NONE;
+	timer->next = schedule_wheel[list];
+	if (timer->next != SCHEDULE_TIMER_NONE) {
+		schedule_timers[timer->next].prev = t;
+	}
+	schedule_wheel[list] = t;
+}
+
+// Run everything due at schedule_now
+static void schedule_expire(void) {
+	uint8_t t;
+	uint8_t list;
+	__xdata schedule_timer_t *timer;
+	#if PROFILE_ENABLED == 1
+	static __xdata uint32_t started;
+	#endif
+
+	// Bring the next turn's timers down from the second level
+	if ((schedule_now & SCHEDULE_WHEEL_MASK) == 0) {
+		list = SCHEDULE_WHEEL_SLOTS +
+		       ((schedule_now >> SCHEDULE_WHEEL_BITS) & SCHEDULE_WHEEL_MASK);
+		while ((t = schedule_wheel[list]) != SCHEDULE_TIMER_NONE) {
+			schedule_unlink(t);
+			schedule_place(t);
+		}
+	}
+
+	list = schedule_now & SCHEDULE_WHEEL_MASK;
+	// Callbacks can start and cancel timers (none of which can land
+	// in this slot), so always take the head again
+	while ((t = schedule_wheel[list]) != SCHEDULE_TIMER_NONE) {
+		timer = &schedule_timers[t];
+		schedule_unlink(t);
+		if (timer->period) {
+			timer->expires += timer->period;
+			schedule_place(t);
+		} else {
+			timer->list = SCHEDULE_FREE;
+			timer->next = schedule_free;
+			schedule_free = t;
+		}
+		SCHEDULE_DISPATCH_HOOK_ENTER
+		#if PROFILE_ENABLED == 1
+		started = profile_now();
+		#endif
+		timer->callback(t);
+		#if PROFILE_ENABLED == 1
+		profile_add(PROFILE_TIMERS, started);
+		#endif
+		SCHEDULE_DISPATCH_HOOK_EXIT
+	}
+}
+
+// Catch the wheel up with the milliseconds counted by the Timer 1 ISR.
+// Only the outermost call runs the wheel, so a callback can't expire
+// timers underneath the schedule_expire that called it.
+static void schedule_advance(void) {
+	uint16_t tick;
+
+	if (schedule_dispatching) {
+		return;
+	}
+	schedule_dispatching = 1;
+	tick = timers_get_ticks();
+	while (schedule_last_tick != tick) {
+		schedule_last_tick++;
+		schedule_now++;
+		schedule_expire();
+	}
+	schedule_dispatching = 0;
+}
+
+// Have the Timer 1 ISR raise EVENT_TICK when the next slot with
+// timers in it (or the next turn of the first level) comes up
+static void schedule_arm(void) {
+	uint8_t delay;
+
+	for (delay = 1; delay < SCHEDULE_WHEEL_SLOTS; delay++) {
+		if (((schedule_now + delay) & SCHEDULE_WHEEL_MASK) == 0 ||
+		    schedule_wheel[(schedule_now + delay) & SCHEDULE_WHEEL_MASK] !=
+		    SCHEDULE_TIMER_NONE) {
+			break;
+		}
+	}
+	timers_wake_at(schedule_last_tick + delay);
+}
+
+uint8_t schedule_timer_start(uint16_t delay_ms, uint16_t period_ms,
+                             schedule_callback_t callback) {
+	uint8_t t;
+	__xdata schedule_timer_t *timer;
+
+	t = schedule_free;
+	if (t == SCHEDULE_TIMER_NONE) {
+		return SCHEDULE_TIMER_NONE;
+	}
+	timer = &schedule_timers[t];
+	schedule_free = timer->next;
+	if (delay_ms == 0) {
+		delay_ms = 1;
+	}
+	timer->callback = callback;
+	// The wheel may be behind the ISR's count, so add the difference
+	// rather than running it here (which would call other timers'
+	// callbacks from inside this one's caller)
+	timer->expires = schedule_now +
+	                 (uint16_t) (timers_get_ticks() - schedule_last_tick) +
+	                 delay_ms;
+	timer->period = period_ms;
+	schedule_place(t);
+	if (!schedule_dispatching) {
+		schedule_arm();
+	}
+	return t;
+}
+
+void schedule_timer_cancel(uint8_t timer) {
+	if (timer >= SCHEDULE_TIMERS || schedule_timers[timer].list == SCHEDULE_FREE) {
+		return;
+	}
+	schedule_unlink(timer);
+	schedule_timers[timer].list = SCHEDULE_FREE;
+	schedule_timers[timer].next = schedule_free;
+	schedule_free = timer;
+}
+
+static void schedule_slow(uint8_t timer) {
+	(void) timer;
+
+	// Reboot if our uptime is too high
+	if (auto_reboot != 0 && uptime >= auto_reboot) {
+		watchdog_reboot_now();
+	}
+
+	update_telemetry();
+	// Assume that this will take < 100ms
+	// Othewise we may have some garbage samples
+	adc_start_sample();
+	// If we haven't recieved a packet in a while
+	// reset the receiver
+	if (++last_rx_ticks >= MAX_RX_TICKS) {
+		last_rx_ticks = 0;
+		radio_listen();
+	}
+}
+
 void schedule_init(void) {
+	uint8_t i;
+
+	for (i = 0; i < 2 * SCHEDULE_WHEEL_SLOTS; i++) {
+		schedule_wheel[i] = SCHEDULE_TIMER_NONE;
+	}
+	for (i = 0; i < SCHEDULE_TIMERS; i++) {
+		schedule_timers[i].list = SCHEDULE_FREE;
+		schedule_timers[i].next = i + 1;
+	}
+	schedule_timers[SCHEDULE_TIMERS - 1].next = SCHEDULE_TIMER_NONE;
+	schedule_free = 0;
+	schedule_now = 0;
+	schedule_dispatching = 0;
+	schedule_last_tick = timers_get_ticks();
+
 	#if AUTO_REBOOT_SECONDS == 0
 	auto_reboot = 0;
 	#else
 	schedule_postpone_reboot(AUTO_REBOOT_SECONDS);
 	#endif
+
+	// The 10Hz housekeeping loop
+	schedule_timer_start(1, SCHEDULE_SLOW_PERIOD, schedule_slow);
 }
 
 uint8_t schedule_postpone_reboot(uint32_t postpone) {
@@ -45,24 +271,6 @@ uint8_t schedule_postpone_reboot(uint32_t postpone) {
 }
 
 void schedule_handle_events(void) {
-	// Reboot if our uptime is too high
-	if (auto_reboot != 0 && uptime >= auto_reboot) {
-		watchdog_reboot_now();
-	}
-
-	// Handle the 10Hz loop
-	if (timer_count_ms == 0) {
-		timer_count_ms = TIMER_COUNT_PERIOD;
-		update_telemetry();
-		// Assume that this will take < 100ms
-		// Othewise we may have some garbage samples
-		adc_start_sample();
-		// If we haven't recieved a packet in a while
-		// reset the receiver
-		if (++last_rx_ticks >= MAX_RX_TICKS) {
-			last_rx_ticks = 0;
-			radio_listen();
-		}
-	}
-
+	schedule_advance();
+	schedule_arm();
 }
@@ -14,6 +14,7 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+
 #ifndef _SCHEDULE_H
 #define _SCHEDULE_H
 #include <stdint.h>
@@ -21,8 +22,32 @@
 #define SCHEDULE_REBOOT_POSTPONED 0
 #define SCHEDULE_REBOOT_TOO_LONG  1
 
+// Timers run from a two level wheel of SCHEDULE_WHEEL_SLOTS slots each:
+// the first is 1ms per slot and the second one first-level turn per
+// slot. Longer delays wait in the second level and are placed again
+// as they come around. Starting and cancelling a timer is O(1) and
+// the timers come from a static pool of SCHEDULE_TIMERS.
+#define SCHEDULE_WHEEL_BITS  5
+#define SCHEDULE_WHEEL_SLOTS (1 << SCHEDULE_WHEEL_BITS)
+#define SCHEDULE_WHEEL_MASK  (SCHEDULE_WHEEL_SLOTS - 1)
+
+#define SCHEDULE_TIMER_NONE 0xff
+
+// Called from schedule_handle_events (never from an ISR) with the
+// timer that expired
+typedef void (*schedule_callback_t)(uint8_t timer);
+
 void schedule_init(void);
 uint8_t schedule_postpone_reboot(uint32_t postpone);
 void schedule_handle_events(void);
 
-#endif
\ No newline at end of file
+// Run callback after delay_ms (at least 1), then every period_ms if
+// that isn't 0. Returns the timer, or SCHEDULE_TIMER_NONE if there are
+// none left. Neither this nor schedule_timer_cancel runs any callbacks,
+// so both are safe to call from anywhere but an ISR.
+uint8_t schedule_timer_start(uint16_t delay_ms, uint16_t period_ms,
+                             schedule_callback_t callback);
+// Stop a timer and free it. Callbacks may cancel their own timer.
+void schedule_timer_cancel(uint8_t timer);
+
+#endif
@@ -0,0 +1,94 @@
+// OpenLST
+// Copyright (C) 2018 Planet Labs Inc.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Ring of decimated telemetry snapshots
+
+#include "board_defaults.h"
+#include "compiler_utils.h"
+#include "stringx.h"
+#include "telem_history.h"
+#include "telemetry.h"
+
+#if TELEM_HISTORY_ENTRIES > 0
+
+// Keeps the ring index arithmetic in 8 bits
+STATIC_ASSERT(telem_history_index_fits, TELEM_HISTORY_ENTRIES < 128);
+
+static __xdata telem_record_t telem_history[TELEM_HISTORY_ENTRIES];
+static __xdata uint8_t telem_history_head;  // The slot written next
+static __xdata uint8_t telem_history_count;
+static __xdata uint32_t telem_history_due;  // Uptime of the next snapshot
+
+void telem_history_init(void) {
+	telem_history_head = 0;
+	telem_history_count = 0;
+	telem_history_due = 0;
+}
+
+void telem_history_update(void) {
+	__xdata telem_record_t *record;
+
+	if (telemetry->uptime < telem_history_due) {
+		return;
+	}
+	telem_history_due = telemetry->uptime + TELEM_HISTORY_PERIOD;
+
+	record = &telem_history[telem_history_head];
+	record->uptime = telemetry->uptime;
+	memcpyx((__xdata void *) record->adc,
+	        (__xdata void *) telemetry->adc,
+	        sizeof(record->adc));
+	record->last_rssi = telemetry->last_rssi;
+	record->packets_sent = telemetry->packets_sent;
+	record->packets_good = telemetry->packets_good;
+	record->packets_rejected_checksum = telemetry->packets_rejected_checksum;
+
+	// Once full, the oldest record is overwritten
+	if (++telem_history_head == TELEM_HISTORY_ENTRIES) {
+		telem_history_head = 0;
+	}
+	if (telem_history_count < TELEM_HISTORY_ENTRIES) {
+		telem_history_count++;
+	}
+}
+
+uint8_t telem_history_read(uint32_t from, uint32_t to,
+                           __xdata telem_record_t *out, uint8_t max) {
+	uint8_t i;
+	uint8_t n;
+	uint8_t found;
+
+	// Start from the oldest record
+	i = telem_history_head + TELEM_HISTORY_ENTRIES - telem_history_count;
+	if (i >= TELEM_HISTORY_ENTRIES) {
+		i -= TELEM_HISTORY_ENTRIES;
+	}
+	found = 0;
+	for (n = 0; n < telem_history_count && found < max; n++) {
+		if (telem_history[i].uptime >= from && telem_history[i].uptime <= to) {
+			memcpyx((__xdata void *) &out[found],
+			        (__xdata void *) &telem_history[i],
+			        sizeof(telem_record_t));
+			found++;
+		}
+		if (++i == TELEM_HISTORY_ENTRIES) {
+			i = 0;
+		}
+	}
+	return found;
+}
+
+#endif
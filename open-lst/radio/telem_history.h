@@ -0,0 +1,51 @@
+// OpenLST
+// Copyright (C) 2018 Planet Labs Inc.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef _TELEM_HISTORY_H
+#define _TELEM_HISTORY_H
+
+#include <stdint.h>
+#include "adc.h"
+#include "auth.h"
+#include "commands.h"
+
+// A ring of decimated housekeeping snapshots, one every
+// TELEM_HISTORY_PERIOD seconds, so the ground can catch up on the
+// time out of contact. Records are stamped with the uptime, which
+// runs whether or not the RTC is set. Counters keep their low 16 bits.
+typedef struct {
+	uint32_t uptime;
+	int16_t adc[ADC_NUM_CHANNELS];
+	int8_t last_rssi;
+	uint16_t packets_sent;
+	uint16_t packets_good;
+	uint16_t packets_rejected_checksum;
+} telem_record_t;
+
+// As many records as fit in one reply, leaving room to authenticate it
+#define TELEM_HISTORY_PER_REPLY (COMMAND_MAX_WRAPPED_DATA / sizeof(telem_record_t))
+
+#if TELEM_HISTORY_ENTRIES > 0
+void telem_history_init(void);
+// Take a snapshot of telemetry if one is due
+void telem_history_update(void);
+// Copy out up to max of the records stamped from..to, oldest first,
+// and return how many there were
+uint8_t telem_history_read(uint32_t from, uint32_t to,
+                           __xdata telem_record_t *out, uint8_t max);
+#endif
+
+#endif
@@ -0,0 +1,238 @@
+// OpenLST
+// Copyright (C) 2018 Planet Labs Inc.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Selected and delta-encoded telemetry fields
+
+#include <stddef.h>
+#include "board_defaults.h"
+#include "compiler_utils.h"
+#include "stringx.h"
+#include "telem_sel.h"
+#include "telemetry.h"
+
+// Each field's size in bytes, and whether it is signed
+#define TELEM_SEL_SIZE   0x07
+#define TELEM_SEL_SIGNED 0x80
+
+typedef struct {
+	uint8_t offset;
+	uint8_t type;
+} telem_sel_field_t;
+
+#define FIELD(name, type) \
+	{ offsetof(telemetry_t, name), sizeof(telemetry->name) | (type) },
+#define ARRAY_FIELD(name, i, type) \
+	{ offsetof(telemetry_t, name) + (i) * sizeof(telemetry->name[0]), \
+	  sizeof(telemetry->name[0]) | (type) },
+#define ADC_FIELDS(name) \
+	ARRAY_FIELD(name, 0, TELEM_SEL_SIGNED) \
+	ARRAY_FIELD(name, 1, TELEM_SEL_SIGNED) \
+	ARRAY_FIELD(name, 2, TELEM_SEL_SIGNED) \
+	ARRAY_FIELD(name, 3, TELEM_SEL_SIGNED) \
+	ARRAY_FIELD(name, 4, TELEM_SEL_SIGNED) \
+	ARRAY_FIELD(name, 5, TELEM_SEL_SIGNED) \
+	ARRAY_FIELD(name, 6, TELEM_SEL_SIGNED) \
+	ARRAY_FIELD(name, 7, TELEM_SEL_SIGNED) \
+	ARRAY_FIELD(name, 8, TELEM_SEL_SIGNED) \
+	ARRAY_FIELD(name, 9, TELEM_SEL_SIGNED)
+
+// In telemetry_t order, which is also the order of the "telem" reply
+// in the ground tools
+static __code const telem_sel_field_t telem_sel_fields[] = {
+	FIELD(reserved, 0)
+	FIELD(uptime, 0)
+	FIELD(uart0_rx_count, 0)
+	FIELD(uart1_rx_count, 0)
+	FIELD(rx_mode, 0)
+	FIELD(tx_mode, 0)
+	ADC_FIELDS(adc)
+	FIELD(last_rssi, TELEM_SEL_SIGNED)
+	FIELD(last_lqi, 0)
+	FIELD(last_freqest, TELEM_SEL_SIGNED)
+	FIELD(packets_sent, 0)
+	FIELD(cs_count, 0)
+	FIELD(packets_good, 0)
+	FIELD(packets_rejected_checksum, 0)
+	FIELD(packets_rejected_reserved, 0)
+	FIELD(packets_rejected_other, 0)
+	FIELD(stack_free, 0)
+	FIELD(xram_free, 0)
+	FIELD(custom0, 0)
+	FIELD(custom1, 0)
+	FIELD(packets_rs_corrected, 0)
+	FIELD(rs_symbols_corrected, 0)
+	FIELD(uart0_rx_dropped, 0)
+	FIELD(uart1_rx_dropped, 0)
+	FIELD(uart0_rts_stall_ms, 0)
+	FIELD(uart1_rts_stall_ms, 0)
+	FIELD(reply_cache_hits, 0)
+	FIELD(schedule_starved, 0)
+	FIELD(uart0_starved, 0)
+	FIELD(uart1_starved, 0)
+	FIELD(rf_starved, 0)
+	FIELD(timetag_queued, 0)
+	ADC_FIELDS(adc_min)
+	ADC_FIELDS(adc_max)
+};
+
+#undef FIELD
+#undef ARRAY_FIELD
+#undef ADC_FIELDS
+
+STATIC_ASSERT(telem_sel_fields_counted,
+              sizeof(telem_sel_fields) / sizeof(telem_sel_fields[0]) == TELEM_SEL_FIELDS);
+STATIC_ASSERT(telem_sel_fields_fit_mask, TELEM_SEL_FIELDS <= 8 * TELEM_SEL_MASK_SIZE);
+STATIC_ASSERT(telem_sel_values_fit,
+              TELEM_SEL_HEADER_SIZE + sizeof(telemetry_t) <= TELEM_SEL_MAX_REPLY);
+
+#if TELEM_DELTA_ENABLED == 1
+// What the last reply was encoded from, and which fields were asked for
+static __xdata telemetry_t telem_sel_sent;
+static __xdata uint8_t telem_sel_sent_mask[TELEM_SEL_MASK_SIZE];
+static __xdata uint8_t telem_sel_id;
+
+// A field as a 32 bit value, sign extended if it is signed
+static uint32_t telem_sel_value(const __xdata uint8_t *field, uint8_t type) {
+	uint8_t i;
+	uint8_t size;
+	uint32_t value;
+
+	size = type & TELEM_SEL_SIZE;
+	value = 0;
+	for (i = size; i > 0; i--) {
+		value = (value << 8) | field[i - 1];
+	}
+	if ((type & TELEM_SEL_SIGNED) && size < sizeof(value) && (field[size - 1] & 0x80)) {
+		value |= 0xffffffff << (size * 8);
+	}
+	return value;
+}
+#endif
+
+// Encode the selected fields as values, or as deltas against
+// telem_sel_sent. Returns the length, or 0 if the deltas didn't fit.
+static uint8_t telem_sel_fill(const __xdata uint8_t *mask, uint8_t delta,
+                              __xdata telem_sel_reply_t *out, uint8_t max) {
+	__xdata uint8_t *buf;
+	uint8_t f;
+	uint8_t bit;
+	uint8_t type;
+	uint8_t size;
+	uint8_t len;
+	#if TELEM_DELTA_ENABLED == 1
+	uint32_t diff;
+	#else
+	(void) delta;
+	#endif
+
+	buf = (__xdata uint8_t *) out;
+	out->delta = delta;
+	memsetx((__xdata void *) out->mask, 0, sizeof(out->mask));
+	len = TELEM_SEL_HEADER_SIZE;
+	for (f = 0; f < TELEM_SEL_FIELDS; f++) {
+		bit = 1 << (f & 7);
+		if (!(mask[f >> 3] & bit)) {
+			continue;
+		}
+		type = telem_sel_fields[f].type;
+		#if TELEM_DELTA_ENABLED == 1
+		if (delta) {
+			diff = telem_sel_value((__xdata uint8_t *) telemetry + telem_sel_fields[f].offset, type) -
+			       telem_sel_value((__xdata uint8_t *) &telem_sel_sent + telem_sel_fields[f].offset, type);
+			if (diff == 0) {
+				continue;
+			}
+			// Zigzag so small negative changes stay short too
+			diff = (diff << 1) ^ ((diff & 0x80000000) ? 0xffffffff : 0);
+			while (diff >= 0x80) {
+				if (len >= max) {
+					return 0;
+				}
+				buf[len++] = diff | 0x80;
+				diff >>= 7;
+			}
+			if (len >= max) {
+				return 0;
+			}
+			buf[len++] = diff;
+			out->mask[f >> 3] |= bit;
+			continue;
+		}
+		#endif
+		// Values always fit (see telem_sel_values_fit)
+		size = type & TELEM_SEL_SIZE;
+		memcpyx((__xdata void *) &buf[len],
+		        (__xdata void *) ((__xdata uint8_t *) telemetry + telem_sel_fields[f].offset),
+		        size);
+		len += size;
+		out->mask[f >> 3] |= bit;
+	}
+	return len;
+}
+
+uint8_t telem_sel_encode(const __xdata uint8_t *mask, uint8_t ack,
+                         __xdata telem_sel_reply_t *out, uint8_t max) {
+	uint8_t len;
+	#if TELEM_DELTA_ENABLED == 1
+	uint8_t f;
+	uint8_t delta;
+
+	// Deltas need the reply they're against to have arrived, and
+	// to have carried every field asked for now
+	delta = 0;
+	if (ack != TELEM_SEL_ID_NONE && ack == telem_sel_id) {
+		delta = 1;
+		for (f = 0; f < TELEM_SEL_MASK_SIZE; f++) {
+			if (mask[f] & ~telem_sel_sent_mask[f]) {
+				delta = 0;
+			}
+		}
+	}
+	// Changed fields can take more room as deltas than as values.
+	// If they don't fit, send values instead.
+	len = 0;
+	if (delta) {
+		len = telem_sel_fill(mask, 1, out, max);
+	}
+	if (len == 0) {
+		len = telem_sel_fill(mask, 0, out, max);
+	}
+
+	if (++telem_sel_id == TELEM_SEL_ID_NONE) {
+		telem_sel_id++;
+	}
+	memcpyx((__xdata void *) &telem_sel_sent,
+	        (__xdata void *) telemetry,
+	        sizeof(telem_sel_sent));
+	// Values always fit, so either way the ground now knows every
+	// field it asked for
+	memcpyx((__xdata void *) telem_sel_sent_mask,
+	        (__xdata void *) mask,
+	        sizeof(telem_sel_sent_mask));
+	out->id = telem_sel_id;
+	#else
+	(void) ack;
+	len = telem_sel_fill(mask, 0, out, max);
+	out->id = TELEM_SEL_ID_NONE;
+	#endif
+	return len;
+}
+
+uint8_t telem_sel_encode_values(const __xdata uint8_t *mask,
+                                __xdata telem_sel_reply_t *out) {
+	out->id = TELEM_SEL_ID_NONE;
+	return telem_sel_fill(mask, 0, out, TELEM_SEL_MAX_REPLY);
+}
@@ -0,0 +1,66 @@
+// OpenLST
+// Copyright (C) 2018 Planet Labs Inc.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef _TELEM_SEL_H
+#define _TELEM_SEL_H
+
+#include <stdint.h>
+#include "auth.h"
+#include "commands.h"
+
+// Selected telemetry fields. Field n is the nth value of telemetry_t,
+// counting each ADC channel (and each min and max) as its own field,
+// and is selected by bit n % 8 of mask[n / 8].
+#define TELEM_SEL_FIELDS 61
+#define TELEM_SEL_MASK_SIZE 8
+
+// No snapshot to take deltas against
+#define TELEM_SEL_ID_NONE 0
+
+typedef struct {
+	uint8_t mask[TELEM_SEL_MASK_SIZE];
+	// Optional: the id of the last reply received. Asks for only the
+	// fields that changed since that reply.
+	uint8_t ack;
+} telem_sel_request_t;
+
+typedef struct {
+	// Acknowledge this to get deltas against this reply next time
+	uint8_t id;
+	// 1 when values are zigzag varint deltas, 0 when they are
+	// little endian values of each field's own size
+	uint8_t delta;
+	// The fields that follow, in order
+	uint8_t mask[TELEM_SEL_MASK_SIZE];
+	uint8_t values[1];
+} telem_sel_reply_t;
+
+#define TELEM_SEL_HEADER_SIZE (2 + TELEM_SEL_MASK_SIZE)
+// The longest reply, leaving room to authenticate it. Every field sent
+// as a value always fits.
+#define TELEM_SEL_MAX_REPLY COMMAND_MAX_WRAPPED_DATA
+
+// Encode the fields of telemetry selected by mask into out, in at most
+// max bytes. With ack (and TELEM_DELTA_ENABLED) the unchanged fields
+// are left out and the rest sent as differences. Returns the length.
+uint8_t telem_sel_encode(const __xdata uint8_t *mask, uint8_t ack,
+                         __xdata telem_sel_reply_t *out, uint8_t max);
+// Encode the selected fields as values, without touching the state
+// kept for deltas (for frames nobody acknowledges)
+uint8_t telem_sel_encode_values(const __xdata uint8_t *mask,
+                                __xdata telem_sel_reply_t *out);
+
+#endif
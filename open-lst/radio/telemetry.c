@@ -16,58 +16,108 @@
 
 // Radio telemetry acquisition and reporting
 
+#include "board_defaults.h"
+#include "events.h"
 #include "telemetry.h"
 #include "adc.h"
+#include "memwatch.h"
 #include "radio.h"
+#include "reply_cache.h"
 #include "stringx.h"
+#include "telem_history.h"
 #include "timers.h"
+#include "timetag.h"
 #include "uart0.h"
 #include "uart1.h"
 
-__xdata telemetry_t telemetry;
+__xdata telemetry_t * __xdata telemetry;
+static __xdata telemetry_t telemetry_buffers[TELEMETRY_BUFFERS];
+volatile __data uint8_t telemetry_seq;
 
 void telemetry_init(void) {
-	memsetx((__xdata void*) &telemetry, 0, sizeof(telemetry));
+	memsetx((__xdata void*) telemetry_buffers, 0, sizeof(telemetry_buffers));
+	telemetry = telemetry_buffers;
 	// This one is signed and we want the default to be
 	// -128dBm rather than 0dBm
-	telemetry.last_rssi = -128;
+	telemetry->last_rssi = -128;
+	#if TELEM_HISTORY_ENTRIES > 0
+	telem_history_init();
+	#endif
 }
 
 void update_telemetry(void) {
-	telemetry.reserved = 0;
-	__critical {
-		telemetry.uptime = uptime;
-		telemetry.uart0_rx_count = uart0_rx_count;
-		telemetry.uart1_rx_count = uart1_rx_count;
-	}
-	if (adc_sample_ready) {
-		// The ADC sample should always be ready except for
-		// the first iteration of this loop. We give it
-		// one full tick of the 10Hz loop (100ms) to complete
-		// the chain of samples, but this check is here
-		// to prevent garbage data in case something the user
-		// added is delaying the ADC sample in the loop.
-		memcpyx(
-			(__xdata void *) telemetry.adc,
-			(__xdata void *) adc_buffer,
-			sizeof(telemetry.adc));
-	}
-	// RSSI is stored as a two's complement value in the RSSI register
-	__critical {
-		telemetry.last_rssi = radio_last_rssi;
-		telemetry.last_lqi = radio_last_lqi;
-		telemetry.last_freqest = radio_last_freqest;
-		telemetry.cs_count = radio_cs_count;
+	__xdata telemetry_t *next;
+	uint8_t seq;
+
+	// Start from the last update, for the fields that don't change
+	// every time (or that board code sets)
+	next = telemetry;
+	#if TELEMETRY_BUFFERS > 1
+	if (++next == telemetry_buffers + TELEMETRY_BUFFERS) {
+		next = telemetry_buffers;
 	}
+	memcpyx((__xdata void *) next, (__xdata void *) telemetry,
+	        sizeof(telemetry_t));
+	#endif
+
+	next->reserved = 0;
+	// Counters that ISRs update are copied without masking
+	// interrupts, again if an ISR changed any of them meanwhile
+	do {
+		seq = telemetry_seq;
+		next->uptime = uptime;
+		next->uart0_rx_count = uart0_rx_count;
+		next->uart1_rx_count = uart1_rx_count;
+		// RSSI is stored as a two's complement value in the RSSI
+		// register
+		next->last_rssi = radio_last_rssi;
+		next->last_lqi = radio_last_lqi;
+		next->last_freqest = radio_last_freqest;
+		next->cs_count = radio_cs_count;
+		next->uart0_rx_dropped = uart0_rx_dropped;
+		next->uart1_rx_dropped = uart1_rx_dropped;
+		#if CONFIG_UART0_USE_FLOW_CTRL == 1
+		next->uart0_rts_stall_ms = uart0_rts_stall_ms;
+		#endif
+		#if CONFIG_UART1_USE_FLOW_CTRL == 1
+		next->uart1_rts_stall_ms = uart1_rts_stall_ms;
+		#endif
+	} while (seq != telemetry_seq);
+	// The ADC sample should always be ready except for
+	// the first iteration of this loop. We give it
+	// one full tick of the 10Hz loop (100ms) to complete
+	// the chain of samples, but adc_collect skips it
+	// to prevent garbage data in case something the user
+	// added is delaying the ADC sample in the loop.
+	adc_collect(next->adc, next->adc_min, next->adc_max);
 
-	telemetry.rx_mode = radio_mode_rx;
-	telemetry.tx_mode = radio_mode_tx;
-	//TODO cs_count
+	next->rx_mode = radio_mode_rx;
+	next->tx_mode = radio_mode_tx;
 
-	telemetry.packets_sent = radio_packets_sent;
-	telemetry.packets_good = radio_packets_good;
-	telemetry.packets_rejected_checksum = radio_packets_rejected_checksum;
-	telemetry.packets_rejected_reserved = radio_packets_rejected_reserved;
-	telemetry.packets_rejected_other = radio_packets_rejected_other;
+	next->packets_sent = radio_packets_sent;
+	next->packets_good = radio_packets_good;
+	next->packets_rejected_checksum = radio_packets_rejected_checksum;
+	next->packets_rejected_reserved = radio_packets_rejected_reserved;
+	next->packets_rejected_other = radio_packets_rejected_other;
+	next->packets_rs_corrected = radio_packets_rs_corrected;
+	next->rs_symbols_corrected = radio_rs_symbols_corrected;
+	#if REPLY_CACHE_ENTRIES > 0
+	next->reply_cache_hits = reply_cache_hits;
+	#endif
+	memcpyx(
+		(__xdata void *) &next->schedule_starved,
+		(__xdata void *) main_loop_starved,
+		sizeof(main_loop_starved));
+	#if TIMETAG_ENTRIES > 0
+	next->timetag_queued = timetag_queued;
+	#endif
+	#if MEMWATCH_ENABLED == 1
+	next->stack_free = memwatch_stack_free();
+	next->xram_free = memwatch_xram_free();
+	#endif
+	telemetry = next;
+	#if TELEM_HISTORY_ENTRIES > 0
+	telem_history_update();
+	#endif
 
 }
@@ -36,14 +36,30 @@ typedef struct {
 	uint32_t packets_rejected_checksum;
 	uint32_t packets_rejected_reserved;
 	uint32_t packets_rejected_other;
-	uint32_t reserved0;
-	uint32_t reserved1;
+	uint32_t stack_free;
+	uint32_t xram_free;
 	uint32_t custom0;
 	uint32_t custom1;
+	uint32_t packets_rs_corrected;
+	uint32_t rs_symbols_corrected;
+	uint32_t uart0_rx_dropped;
+	uint32_t uart1_rx_dropped;
+	uint32_t uart0_rts_stall_ms;
+	uint32_t uart1_rts_stall_ms;
+	uint32_t reply_cache_hits;
+	uint32_t schedule_starved;
+	uint32_t uart0_starved;
+	uint32_t uart1_starved;
+	uint32_t rf_starved;
+	uint32_t timetag_queued;
+	int16_t adc_min[ADC_NUM_CHANNELS];
+	int16_t adc_max[ADC_NUM_CHANNELS];
 
 } telemetry_t;
 
-extern __xdata telemetry_t telemetry;
+// update_telemetry fills the buffer that isn't being read and then
+// points telemetry at it, so readers always see one whole update
+extern __xdata telemetry_t * __xdata telemetry;
 
 void telemetry_init(void);
 void update_telemetry(void);
@@ -18,8 +18,14 @@
 #include "board_defaults.h"
 #include "cc1110_regs.h"
 #include "compiler_utils.h"
+#include "events.h"
+#include "profile_isr.h"
+#include "schedule.h"
 #include "telemetry.h"
 #include "timers.h"
+#include "uart.h"
+#include "uart0.h"
+#include "uart1.h"
 
 STATIC_ASSERT(timer_period_non_zero, T1_PERIOD > 0);
 STATIC_ASSERT(rf_precise_timing_non_zero, RF_PRECISE_TIMING_DELAY > 0);
@@ -28,18 +34,47 @@ volatile __bit rtc_set = 0;
 volatile __data uint32_t uptime;
 volatile __data uint32_t rtc_seconds;
 volatile __data uint16_t rtc_milliseconds;
-volatile __data uint16_t timer_count_ms;
+// Free running milliseconds
+volatile __data uint16_t timer_ticks;
+__xdata uint16_t timers_fine;
+#if TIMERS_TICKLESS == 1
+// Counts past timer_ticks at the last overflow the ISR handled
+static volatile __xdata uint16_t timer_wrap_counts;
+// Compare matches left until EVENT_TICK is due (0 when nothing is
+// waiting)
+static volatile __xdata uint16_t timer_compare_wraps;
+// Whole milliseconds from the ISR's count to the last timers_sample
+static __xdata uint8_t timers_ahead;
+static __xdata uint16_t timers_count;
+#else
+// Milliseconds until schedule_handle_events is next due (0 when
+// nothing is waiting)
+static volatile __data uint16_t timer_count_ms;
+#endif
 
 uint8_t transmit_delay;
 
 void timers_init(void) {
 	uptime = 0;
-	timer_count_ms = 0; // run this loop immediately on boot
+	timer_ticks = 0;
 
 	rtc_set = 0;
 	rtc_seconds = 0;
 	rtc_milliseconds = 0;
 
+	#if TIMERS_TICKLESS == 1
+	timer_wrap_counts = 0;
+	timer_compare_wraps = 0;
+	// Channel 0 is off until timers_wake_at needs it, so it never
+	// matches while nothing is waiting
+	T1CCTL0 = 0;
+	T1CTL = T1CTL_DIV_1 |  // Main clock divided by 1
+	        T1CTL_MODE_FREE_RUN;  // Count over all 16 bits
+	TIMIF |= TIMIF_OVFIM;  // Interrupt on overflow
+	IEN1 |= IEN1_T1IE;  // Enable the Timer 1 ISR
+	#else
+	timer_count_ms = 0;
+
 	// Set Timer 1 to overflow every 1ms
 	T1CC0H = (T1_PERIOD - 1) >> 8;
 	T1CC0L = (T1_PERIOD - 1) & 0xff;
@@ -51,6 +86,165 @@ void timers_init(void) {
 	        T1CTL_MODE_MODULO;  // Reset to 0 when the CC value is reached
 	TIMIF |= TIMIF_OVFIM;  // Clear the Timer 1 "overflow" ISR flag
 	IEN1 |= IEN1_T1IE;  // Enable the Timer 1 ISR
+	#endif
+}
+
+#if TIMERS_TICKLESS == 1
+// With Timer 1 interrupts off, work out how far the time is past what
+// the ISR has counted: whole milliseconds in timers_ahead and counts
+// into the current one in timers_fine. An overflow the ISR hasn't
+// handled yet (the flag is set but the counter is low) is included.
+static void timers_sample(void) {
+	uint32_t fine;
+	uint8_t ahead;
+
+	timers_count = T1CNTL;
+	timers_count |= T1CNTH << 8;
+	fine = (uint32_t) timer_wrap_counts + timers_count;
+	if ((T1CTL & T1CTL_OVFIF) && timers_count < 0x8000) {
+		fine += 65536UL;
+	}
+	ahead = 0;
+	while (fine >= T1_PERIOD) {
+		fine -= T1_PERIOD;
+		ahead++;
+	}
+	timers_ahead = ahead;
+	timers_fine = fine;
+}
+
+uint16_t timers_get_ticks(void) {
+	uint16_t ms;
+
+	TIMER_INTERRUPTS_DISABLE;
+	timers_sample();
+	ms = timer_ticks + timers_ahead;
+	TIMER_INTERRUPTS_ENABLE;
+	return ms;
+}
+
+// Timer 1 channel 0 matches once per overflow, so count the matches
+// down to the one at the start of the millisecond we want
+void timers_wake_at(uint16_t tick) {
+	int16_t delay;
+	uint32_t counts;
+	uint16_t compare;
+	uint16_t passed;
+
+	TIMER_INTERRUPTS_DISABLE;
+	T1CCTL0 = 0;
+	timers_sample();
+	delay = tick - (uint16_t) (timer_ticks + timers_ahead);
+	timer_compare_wraps = 0;
+	if (delay > 0) {
+		counts = (uint32_t) delay * T1_PERIOD - timers_fine;
+		compare = timers_count + (uint16_t) counts;
+		T1CTL &= ~(T1CTL_CH0IF);
+		T1CC0L = compare & 0xff;
+		T1CC0H = compare >> 8;
+		T1CCTL0 = T1CCTL0_MODE_COMPARE;
+		timer_compare_wraps = (counts + 0xffff) >> 16;
+		// If the counter got to the compare value before the channel
+		// was on, that match never happens
+		passed = T1CNTL;
+		passed |= T1CNTH << 8;
+		passed -= timers_count;
+		if ((uint16_t) counts != 0 && !(T1CTL & T1CTL_CH0IF) &&
+		    passed >= (uint16_t) counts) {
+			timer_compare_wraps--;
+		}
+	}
+	if (timer_compare_wraps == 0) {
+		T1CCTL0 = 0;
+		EVENT_SET(EVENT_TICK);
+	} else {
+		T1CCTL0 = T1CCTL0_MODE_COMPARE | T1CCTL0_IM_ENABLED;
+	}
+	TIMER_INTERRUPTS_ENABLE;
+}
+
+void timers_get_time(__xdata timespec_t *t) {
+	uint16_t milliseconds;
+
+	TIMER_INTERRUPTS_DISABLE;
+	t->seconds = rtc_seconds;
+	milliseconds = rtc_milliseconds;
+	timers_sample();
+	TIMER_INTERRUPTS_ENABLE;
+
+	milliseconds += timers_ahead;
+	if (milliseconds >= 1000) {
+		milliseconds -= 1000;
+		t->seconds++;
+	}
+	t->nanoseconds = ((uint32_t) milliseconds * 1000000) + timers_fine * T1_TICK;
+}
+
+uint32_t timers_get_seconds(void) {
+	uint32_t seconds;
+	uint16_t milliseconds;
+
+	TIMER_INTERRUPTS_DISABLE;
+	seconds = rtc_seconds;
+	milliseconds = rtc_milliseconds;
+	timers_sample();
+	TIMER_INTERRUPTS_ENABLE;
+	if (milliseconds + timers_ahead >= 1000) {
+		seconds++;
+	}
+	return seconds;
+}
+
+// Set the time as of the ISR's last overflow, which is where it counts
+// on from
+void timers_set_time(const __xdata timespec_t *t) {
+	uint16_t milliseconds;
+	uint32_t seconds;
+
+	milliseconds = t->nanoseconds / 1000000;
+	seconds = t->seconds;
+	TIMER_INTERRUPTS_DISABLE;
+	timers_sample();
+	if (milliseconds < timers_ahead) {
+		milliseconds += 1000;
+		seconds--;
+	}
+	rtc_milliseconds = milliseconds - timers_ahead;
+	rtc_seconds = seconds;
+	rtc_set = 1;
+	TIMER_INTERRUPTS_ENABLE;
+}
+#else
+// The counter wraps every 1ms, so if it wrapped while we weren't
+// looking (the compare flag is still set) the millisecond count is
+// one behind.
+uint16_t timers_get_ticks(void) {
+	uint16_t ms;
+	uint16_t count;
+
+	TIMER_INTERRUPTS_DISABLE;
+	ms = timer_ticks;
+	count = T1CNTL;
+	count |= T1CNTH << 8;
+	if ((T1CTL & T1CTL_CH0IF) && count < T1_PERIOD / 2) {
+		ms++;
+	}
+	TIMER_INTERRUPTS_ENABLE;
+	timers_fine = count;
+	return ms;
+}
+
+void timers_wake_at(uint16_t tick) {
+	uint16_t delay;
+
+	// Count from where the ISR is, which may be ahead of the caller
+	TIMER_INTERRUPTS_DISABLE;
+	delay = tick - timer_ticks;
+	if ((int16_t) delay <= 0) {
+		delay = 1;
+	}
+	timer_count_ms = delay;
+	TIMER_INTERRUPTS_ENABLE;
 }
 
 void timers_get_time(__xdata timespec_t *t) {
@@ -84,6 +278,7 @@ void timers_set_time(const __xdata timespec_t *t) {
 	rtc_set = 1;
 	TIMER_INTERRUPTS_ENABLE;
 }
+#endif
 
 void timers_add_time(__xdata timespec_t *t1, __xdata timespec_t *t2) {
 	t1->nanoseconds += t2->nanoseconds;
@@ -151,22 +346,78 @@ void timers_trigger_for_RF(void) {
 }
 
 void t1_isr(void)  __interrupt (T1_VECTOR) __using (1) {
+	#if TIMERS_TICKLESS == 1
+	uint8_t ms;
+	#endif
+
+	PROFILE_ISR_ENTER(PROFILE_ISR_T1);
+	#if TIMERS_TICKLESS == 1
+	if (T1CTL & T1CTL_OVFIF) {
+		T1CTL &= ~(T1CTL_OVFIF);
+		SCHEDULE_ISR_HOOK_ENTER
+		ms = T1_WRAP_MS;
+		timer_wrap_counts += T1_WRAP_COUNTS;
+		if (timer_wrap_counts >= T1_PERIOD) {
+			timer_wrap_counts -= T1_PERIOD;
+			ms++;
+		}
+		timer_ticks += ms;
+		rtc_milliseconds += ms;
+		if (rtc_milliseconds >= 1000) {
+			rtc_milliseconds -= 1000;
+			rtc_seconds++;
+			uptime++;
+			TELEMETRY_SEQ_BUMP
+		}
+		#if UART0_ENABLED == 1
+		UART0_FLOW_TICK(ms)
+		#endif
+		#if UART1_ENABLED == 1
+		UART1_FLOW_TICK(ms)
+		#endif
+		SCHEDULE_ISR_HOOK_EXIT
+	}
 	if (T1CTL & T1CTL_CH0IF) {
 		T1CTL &= ~(T1CTL_CH0IF);
+		if (timer_compare_wraps != 0 && --timer_compare_wraps == 0) {
+			T1CCTL0 = 0;
+			EVENT_SET(EVENT_TICK);
+		}
+	}
+	#else
+	if (T1CTL & T1CTL_CH0IF) {
+		T1CTL &= ~(T1CTL_CH0IF);
+		SCHEDULE_ISR_HOOK_ENTER
 		rtc_milliseconds += 1;
+		timer_ticks++;
 		if (timer_count_ms != 0) {
-			timer_count_ms--;
+			if (--timer_count_ms == 0) {
+				EVENT_SET(EVENT_TICK);
+			}
 		}
 		if (rtc_milliseconds >= 1000) {
 			rtc_milliseconds = 0;
 			rtc_seconds++;
 			uptime++;
+			TELEMETRY_SEQ_BUMP
 		}
-	} else if (T1CTL & T1CTL_CH1IF) {
-		// Timer 1 Channel 1 is used for RF event capture and precision TX
+		#if UART0_ENABLED == 1
+		UART0_FLOW_TICK(1)
+		#endif
+		#if UART1_ENABLED == 1
+		UART1_FLOW_TICK(1)
+		#endif
+		SCHEDULE_ISR_HOOK_EXIT
+	}
+	#endif
+	// Timer 1 Channel 1 is used for RF event capture and precision TX.
+	// It can be due in the same pass as the tick, so check it on its
+	// own, but only while it is armed.
+	if ((T1CTL & T1CTL_CH1IF) && (T1CCTL1 & T1CCTL1_IM_ENABLED)) {
 		if (T1CCTL1 & T1CCTL1_CPSEL_RF_EVENT) {
 			// If we're set to capture, disable the trigger after the first
 			// capture
+			T1CTL &= ~(T1CTL_CH1IF);
 			T1CCTL1 = 0;
 		} else {
 			// RF event start for precise timing
@@ -177,4 +428,5 @@ void t1_isr(void)  __interrupt (T1_VECTOR) __using (1) {
 			}
 		}
 	}
+	PROFILE_ISR_EXIT(PROFILE_ISR_T1);
 }
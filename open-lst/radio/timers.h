@@ -32,8 +32,13 @@
 // 1ms period
 #define T1_PERIOD (F_CLK / 1000)
 #define T1_TICK (1000000000 / F_CLK)
-// 100ms
-#define TIMER_COUNT_PERIOD 100
+
+#if TIMERS_TICKLESS == 1
+// Timer 1 runs free over all 16 bits and its ISR counts the overflows,
+// each T1_WRAP_MS milliseconds and T1_WRAP_COUNTS counts
+#define T1_WRAP_MS (65536UL / T1_PERIOD)
+#define T1_WRAP_COUNTS (65536UL % T1_PERIOD)
+#endif
 
 typedef struct {
 	uint32_t seconds;
@@ -46,6 +51,12 @@ uint32_t timers_get_seconds(void);
 void timers_set_time(const __xdata timespec_t *t);
 void timers_add_time(__xdata timespec_t *t1, __xdata timespec_t *t2);
 void timers_subtract_time(__xdata timespec_t *t1, __xdata timespec_t *t2);
+// Milliseconds since boot, like timer_ticks, leaving the Timer 1
+// counts since the start of that millisecond in timers_fine
+uint16_t timers_get_ticks(void);
+// Raise EVENT_TICK once timers_get_ticks reaches tick (straight away
+// if it already has)
+void timers_wake_at(uint16_t tick);
 void timers_watch_for_RF(void);
 void timers_trigger_for_RF(void);
 
@@ -53,6 +64,7 @@ void t1_isr(void)  __interrupt (T1_VECTOR) __using (1);
 
 extern volatile __bit rtc_set;
 extern volatile __data uint32_t uptime;
-extern volatile __data uint16_t timer_count_ms;
+extern volatile __data uint16_t timer_ticks;
+extern __xdata uint16_t timers_fine;
 
 #endif
@@ -0,0 +1,201 @@
+// OpenLST
+// Copyright (C) 2018 Planet Labs Inc.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// Time-tagged command queue
+
+#include "board_defaults.h"
+#include "input_handlers.h"
+#include "schedule.h"
+#include "stringx.h"
+#include "timetag.h"
+#include "timers.h"
+
+#if TIMETAG_ENTRIES > 0
+
+// Checking is rescheduled at least this often, which covers commands
+// far in the future and changes to the RTC
+#define TIMETAG_MAX_WAIT_MS 60000
+
+typedef struct {
+	timespec_t at;
+	uint16_t seqnum;
+	uint8_t source;
+	uint8_t authenticated;
+	uint8_t len;  // 0 when free
+	uint8_t cmd[TIMETAG_MAX_COMMAND];
+} timetag_entry_t;
+
+static __xdata timetag_entry_t timetag_entries[TIMETAG_ENTRIES];
+static __xdata timespec_t timetag_now;
+static __xdata uint8_t timetag_timer;
+__xdata uint8_t timetag_queued;
+
+static void timetag_run(uint8_t timer);
+
+// The queued command due first, or TIMETAG_NONE
+static uint8_t timetag_first(void) {
+	uint8_t i;
+	uint8_t first;
+
+	first = TIMETAG_NONE;
+	for (i = 0; i < TIMETAG_ENTRIES; i++) {
+		if (!timetag_entries[i].len) {
+			continue;
+		}
+		if (first == TIMETAG_NONE ||
+		    timetag_entries[i].at.seconds < timetag_entries[first].at.seconds ||
+		    (timetag_entries[i].at.seconds == timetag_entries[first].at.seconds &&
+		     timetag_entries[i].at.nanoseconds < timetag_entries[first].at.nanoseconds)) {
+			first = i;
+		}
+	}
+	return first;
+}
+
+// Milliseconds from now until entry i is due (rounded up), or 0 if
+// it's due already
+static uint16_t timetag_wait_ms(uint8_t i) {
+	__xdata timetag_entry_t *entry;
+	int32_t ms;
+
+	entry = &timetag_entries[i];
+	if (entry->at.seconds < timetag_now.seconds) {
+		return 0;
+	}
+	if (entry->at.seconds - timetag_now.seconds > TIMETAG_MAX_WAIT_MS / 1000) {
+		return TIMETAG_MAX_WAIT_MS;
+	}
+	ms = (int32_t) (entry->at.seconds - timetag_now.seconds) * 1000 +
+	     ((int32_t) entry->at.nanoseconds - (int32_t) timetag_now.nanoseconds + 999999) /
+	     1000000;
+	if (ms <= 0) {
+		return 0;
+	}
+	return ms;
+}
+
+void timetag_rearm(void) {
+	uint8_t first;
+	uint16_t wait;
+
+	schedule_timer_cancel(timetag_timer);
+	timetag_timer = SCHEDULE_TIMER_NONE;
+	first = timetag_first();
+	if (first == TIMETAG_NONE || !rtc_set) {
+		return;
+	}
+	timers_get_time(&timetag_now);
+	wait = timetag_wait_ms(first);
+	timetag_timer = schedule_timer_start(wait, 0, timetag_run);
+}
+
+// Run everything that's due, earliest first
+static void timetag_run(uint8_t timer) {
+	uint8_t first;
+	uint8_t len;
+	__xdata timetag_entry_t *entry;
+
+	(void) timer;
+	timetag_timer = SCHEDULE_TIMER_NONE;
+	while (1) {
+		first = timetag_first();
+		if (first == TIMETAG_NONE || !rtc_set) {
+			break;
+		}
+		timers_get_time(&timetag_now);
+		if (timetag_wait_ms(first) != 0) {
+			break;
+		}
+		// Free the entry first, the command may queue another (the
+		// bytes are copied out before it runs)
+		entry = &timetag_entries[first];
+		len = entry->len;
+		entry->len = 0;
+		timetag_queued--;
+		input_dispatch_command(entry->source, entry->seqnum,
+		                       entry->authenticated, entry->cmd, len);
+	}
+	timetag_rearm();
+}
+
+void timetag_init(void) {
+	uint8_t i;
+
+	for (i = 0; i < TIMETAG_ENTRIES; i++) {
+		timetag_entries[i].len = 0;
+	}
+	timetag_queued = 0;
+	timetag_timer = SCHEDULE_TIMER_NONE;
+}
+
+uint8_t timetag_add(const __xdata timespec_t *at,
+                    const __xdata uint8_t *cmd, uint8_t len,
+                    uint16_t seqnum, uint8_t source, uint8_t authenticated) {
+	uint8_t i;
+	__xdata timetag_entry_t *entry;
+
+	if (len == 0 || len > TIMETAG_MAX_COMMAND) {
+		return TIMETAG_NONE;
+	}
+	for (i = 0; i < TIMETAG_ENTRIES; i++) {
+		entry = &timetag_entries[i];
+		if (entry->len) {
+			continue;
+		}
+		memcpyx((__xdata void *) &entry->at, (__xdata void *) at, sizeof(entry->at));
+		memcpyx((__xdata void *) entry->cmd, (__xdata void *) cmd, len);
+		entry->seqnum = seqnum;
+		entry->source = source;
+		entry->authenticated = authenticated;
+		entry->len = len;
+		timetag_queued++;
+		timetag_rearm();
+		return i;
+	}
+	return TIMETAG_NONE;
+}
+
+uint8_t timetag_cancel(uint8_t id) {
+	if (id >= TIMETAG_ENTRIES || !timetag_entries[id].len) {
+		return 0;
+	}
+	timetag_entries[id].len = 0;
+	timetag_queued--;
+	timetag_rearm();
+	return 1;
+}
+
+uint8_t timetag_list(__xdata timetag_info_t *out) {
+	uint8_t i;
+	uint8_t count;
+
+	count = 0;
+	for (i = 0; i < TIMETAG_ENTRIES; i++) {
+		if (!timetag_entries[i].len) {
+			continue;
+		}
+		out[count].id = i;
+		memcpyx((__xdata void *) &out[count].at,
+		        (__xdata void *) &timetag_entries[i].at,
+		        sizeof(out[count].at));
+		out[count].command = timetag_entries[i].cmd[0];
+		count++;
+	}
+	return count;
+}
+
+#endif
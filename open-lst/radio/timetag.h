@@ -0,0 +1,55 @@
+// OpenLST
+// Copyright (C) 2018 Planet Labs Inc.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef _TIMETAG_H
+#define _TIMETAG_H
+
+#include <stdint.h>
+#include "timers.h"
+
+// Time-tagged commands: held in XRAM and run from the schedule when
+// the RTC reaches their time, as if they had just arrived from the
+// link they were queued over. Replies go back the same way and carry
+// the seqnum of the command that queued them.
+
+#define TIMETAG_NONE 0xff
+
+// One queued command as reported by timetag_list
+typedef struct {
+	uint8_t id;
+	timespec_t at;
+	uint8_t command;  // Opcode
+} timetag_info_t;
+
+#if TIMETAG_ENTRIES > 0
+extern __xdata uint8_t timetag_queued;
+
+void timetag_init(void);
+// Queue the len bytes (opcode and data) of cmd to run at the given
+// time. Returns its id, or TIMETAG_NONE if the queue is full.
+uint8_t timetag_add(const __xdata timespec_t *at,
+                    const __xdata uint8_t *cmd, uint8_t len,
+                    uint16_t seqnum, uint8_t source, uint8_t authenticated);
+// Returns 0 if there was no such command
+uint8_t timetag_cancel(uint8_t id);
+// Fill out with the queued commands and return how many there are
+uint8_t timetag_list(__xdata timetag_info_t *out);
+// Recheck the time of the next command (after the RTC is set)
+void timetag_rearm(void);
+#endif
+
+#endif
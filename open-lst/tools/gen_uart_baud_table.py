@@ -0,0 +1,131 @@
+#!/usr/bin/env python
+# OpenLST
+# Copyright (C) 2018 Planet Labs Inc.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+"""Generate common/uart_baud_table.h
+
+The CC1110 UART baud rate is
+    baud = (256 + BAUD_M) * 2 ^ BAUD_E / 2 ^ 28 * F_CLK
+This picks the closest BAUD_M (UxBAUD) and BAUD_E (UxGCR[4:0]) for each
+supported rate and clock and leaves out rates that can't be hit within
+the tolerance, so boards can ask for a rate by number.
+"""
+from __future__ import print_function
+import argparse
+import os
+
+CLOCKS = [26000000, 27000000]
+RATES = [2400, 4800, 9600, 14400, 19200, 28800, 38400, 57600, 76800,
+         115200, 230400, 250000, 460800, 500000, 921600, 1000000]
+# Maximum error (in percent) allowed for an entry
+TOLERANCE = 1.5
+# The UART oversamples by 16 so this is the fastest usable rate
+OVERSAMPLING = 16
+
+DEFAULT_OUTPUT = os.path.join(
+    os.path.dirname(os.path.abspath(__file__)),
+    '..', 'common', 'uart_baud_table.h')
+
+HEADER = """\
+// OpenLST
+// Copyright (C) 2018 Planet Labs Inc.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// UART baud rate settings for each supported F_CLK
+// Generated by tools/gen_uart_baud_table.py - do not edit
+//
+// baud = (256 + BAUD_M) * 2 ^ BAUD_E / 2 ^ 28 * F_CLK
+// Rates with more than {tolerance}% error are left out.
+#ifndef _UART_BAUD_TABLE_H
+#define _UART_BAUD_TABLE_H
+
+"""
+
+FOOTER = """\
+#endif
+
+// Look up the settings for a rate, e.g. UART_BAUD_M(921600). The rate
+// must be written as a plain decimal number. UART_BAUD_OK(rate) is 1
+// if the rate is in the table (and 0 in #if otherwise).
+#define _UART_BAUD_M(rate) UART_BAUD_M_ ## rate
+#define _UART_BAUD_E(rate) UART_BAUD_E_ ## rate
+#define _UART_BAUD_OK(rate) UART_BAUD_OK_ ## rate
+#define UART_BAUD_M(rate) _UART_BAUD_M(rate)
+#define UART_BAUD_E(rate) _UART_BAUD_E(rate)
+#define UART_BAUD_OK(rate) _UART_BAUD_OK(rate)
+
+#endif
+"""
+
+
+def actual_rate(f_clk, m, e):
+    return (256 + m) * 2 ** e * f_clk / float(2 ** 28)
+
+
+def best_setting(f_clk, rate):
+    """Return (error %, M, E) of the closest setting"""
+    best = None
+    for e in range(32):
+        for m in range(256):
+            err = (actual_rate(f_clk, m, e) - rate) * 100. / rate
+            if best is None or abs(err) < abs(best[0]):
+                best = (err, m, e)
+    return best
+
+
+def generate(clocks=CLOCKS, rates=RATES, tolerance=TOLERANCE):
+    out = HEADER.format(tolerance=tolerance)
+    for i, f_clk in enumerate(clocks):
+        out += "#if" if i == 0 else "#elif"
+        out += " F_CLK == %d\n" % f_clk
+        for rate in rates:
+            err, m, e = best_setting(f_clk, rate)
+            if abs(err) > tolerance or rate > f_clk // OVERSAMPLING:
+                out += "// %d is not supported (%+.2f%% error)\n" % (
+                    rate, err)
+                continue
+            out += "#define UART_BAUD_M_%d %d  // %.0f baud (%+.2f%%)\n" % (
+                rate, m, actual_rate(f_clk, m, e), err)
+            out += "#define UART_BAUD_E_%d %d\n" % (rate, e)
+            out += "#define UART_BAUD_OK_%d 1\n" % rate
+    out += FOOTER
+    return out
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument(
+        '-o', '--output',
+        default=DEFAULT_OUTPUT,
+        help="The header file to write (default: %(default)s)")
+    args = parser.parse_args()
+    with open(args.output, 'w') as f:
+        f.write(generate())
+
+
+if __name__ == '__main__':
+    main()
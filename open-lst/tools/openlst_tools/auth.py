@@ -0,0 +1,145 @@
+# OpenLST
+# Copyright (C) 2018 Planet Labs Inc.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+"""AES-CCM command authentication matching radio/auth.c
+
+Secure messages wrap a normal command (opcode + data) as:
+    counter (uint32 LE) | encrypted opcode + data | encrypted 8 byte MIC
+with the 6 byte header and the counter authenticated in the clear.
+"""
+import struct
+from Crypto.Cipher import AES
+
+SECURE = '\x1c'
+HEADER_LEN = 6
+COUNTER_LEN = 4
+MIC_LEN = 8
+BLOCK_LEN = 16
+
+DIR_COMMAND = 0
+DIR_REPLY = 1
+
+# CCM flags for B0 (Adata, M = 8, L = 2) and the counter blocks (L = 2)
+CCM_FLAGS_B0 = 0x59
+CCM_FLAGS_CTR = 0x01
+
+
+class AuthError(Exception):
+    pass
+
+
+def _xor(a, b):
+    return bytearray(x ^ y for x, y in zip(a, b))
+
+
+class CCM(object):
+    """RFC 3610 CCM with a 13 byte nonce and an 8 byte MIC"""
+
+    def __init__(self, key):
+        self.aes = AES.new(bytes(key), AES.MODE_ECB)
+
+    def _encrypt_block(self, block):
+        return bytearray(self.aes.encrypt(bytes(block)))
+
+    def _mac(self, nonce, aad, data):
+        blocks = bytearray([CCM_FLAGS_B0]) + nonce + struct.pack('>H', len(data))
+        a = bytearray(struct.pack('>H', len(aad))) + aad
+        a += bytearray(-len(a) % BLOCK_LEN)
+        blocks += a
+        blocks += data + bytearray(-len(data) % BLOCK_LEN)
+        x = bytearray(BLOCK_LEN)
+        for i in range(0, len(blocks), BLOCK_LEN):
+            x = self._encrypt_block(_xor(x, blocks[i:i + BLOCK_LEN]))
+        return x[:MIC_LEN]
+
+    def _keystream(self, nonce, i):
+        return self._encrypt_block(
+            bytearray([CCM_FLAGS_CTR]) + nonce + struct.pack('>H', i))
+
+    def _ctr(self, nonce, data):
+        out = bytearray()
+        for i in range(0, len(data), BLOCK_LEN):
+            out += _xor(data[i:i + BLOCK_LEN],
+                        self._keystream(nonce, i // BLOCK_LEN + 1))
+        return out
+
+    def encrypt(self, nonce, aad, data):
+        tag = self._mac(nonce, aad, data)
+        return (self._ctr(nonce, data) +
+                _xor(tag, self._keystream(nonce, 0)))
+
+    def decrypt(self, nonce, aad, data):
+        if len(data) < MIC_LEN:
+            raise AuthError("message too short")
+        plain = self._ctr(nonce, data[:-MIC_LEN])
+        tag = _xor(data[-MIC_LEN:], self._keystream(nonce, 0))
+        if self._mac(nonce, aad, plain) != tag:
+            raise AuthError("authentication failed")
+        return plain
+
+
+class AuthSession(object):
+    """Wrap commands to one radio and unwrap its replies
+
+    The session ID comes from the radio (lst get_auth_session) and
+    changes every time it reboots. Counters restart at 1 for each
+    session and must only ever increase. The radio also reports the
+    last counter it accepted, so a new process carries on from there
+    rather than from 1.
+    """
+
+    def __init__(self, key, hwid):
+        self.ccm = CCM(key)
+        self.hwid = hwid
+        self.session = None
+        self.counter = 0
+
+    def start(self, session, last_counter=0):
+        self.session = session
+        self.counter = last_counter
+
+    def _nonce(self, direction, counter):
+        return bytearray(struct.pack('<BHLL', direction, self.hwid,
+                                     self.session, counter) + '\0\0')
+
+    def wrap(self, msg):
+        """Wrap a message (header + opcode + data) in a secure message"""
+        if self.session is None:
+            raise AuthError("no session")
+        msg = bytearray(msg)
+        self.counter += 1
+        out = msg[:HEADER_LEN - 1] + SECURE
+        out += struct.pack('<L', self.counter)
+        out += self.ccm.encrypt(
+            self._nonce(DIR_COMMAND, self.counter),
+            out, msg[HEADER_LEN - 1:])
+        return out
+
+    def unwrap(self, msg):
+        """Return the inner message from a secure reply
+
+        Messages that aren't secure are passed through unchanged.
+        """
+        msg = bytearray(msg)
+        if len(msg) < HEADER_LEN or msg[HEADER_LEN - 1] != ord(SECURE):
+            return msg
+        if self.session is None:
+            raise AuthError("no session")
+        aad = msg[:HEADER_LEN + COUNTER_LEN]
+        counter, = struct.unpack('<L', bytes(aad[HEADER_LEN:]))
+        plain = self.ccm.decrypt(
+            self._nonce(DIR_REPLY, counter),
+            aad, msg[HEADER_LEN + COUNTER_LEN:])
+        return msg[:HEADER_LEN - 1] + plain
@@ -48,6 +48,13 @@ def main():
         '-i', '--hwid',
         type=hwid_type,
         help="The HWID of the satellite or ground radio")
+    parser.add_argument(
+        '--auth-key',
+        type=aes_key_option,
+        default=os.environ.get('AUTH_KEY'),
+        help="Send the reboot as an authenticated command using this AES-128 "
+        "key (as a hex string). This can also be specified via the "
+        "AUTH_KEY environment variable")
     sig_opt = parser.add_mutually_exclusive_group(required=True)
     sig_opt.add_argument(
         '--signature',
@@ -87,13 +94,15 @@ def main():
     )
     log.info("Inserted signature")
 
-    con = get_handler(args.hwid, args.rx_path, args.tx_path)
+    con = get_handler(args.hwid, args.rx_path, args.tx_path,
+                      auth_key=args.auth_key)
 
     # Get in the bootloader
     in_bootloader = False
     while not in_bootloader:
         # Drop to the bootloader
-        con.send_cmd_once('lst reboot', timeout=0.1)
+        con.send_cmd_once('lst reboot', timeout=0.1,
+                          secure=args.auth_key is not None)
         time.sleep(0.2)
         # Erase application
         try:
@@ -20,15 +20,13 @@ import logging
 from threading import Thread, Lock
 from Queue import Queue, Empty
 from .translator import Translator
+from .auth import AuthSession, AuthError
+from .esp import esp_parser, esp_frame, esp2_frame
 from .radio_mux import DEFAULT_RX_SOCKET, DEFAULT_TX_SOCKET
 
 SEQNUM_MIN = 16
 SEQNUM_MAX = 64000
 
-ESP_START_BYTE_0 = '\x22'
-ESP_START_BYTE_1 = '\x69'
-ESP_HEADER = ESP_START_BYTE_0 + ESP_START_BYTE_1
-
 log = logging.getLogger(__name__)
 
 
@@ -39,7 +37,7 @@ def get_handler(hwid, rx_path, tx_path, **kw):
         tx_path = DEFAULT_TX_SOCKET
 
     if rx_path.startswith('ipc:'):
-        return ZMQCommandHandler(hwid, rx_path, tx_path)
+        return ZMQCommandHandler(hwid, rx_path, tx_path, **kw)
     else:
         return SerialCommandHandler(hwid, rx_path, **kw)
 
@@ -51,13 +49,17 @@ class ResponseError(Exception):
 class CommandHandler(object):
     __metaclass__ = abc.ABCMeta
 
-    def __init__(self, hwid):
+    def __init__(self, hwid, auth_key=None):
         if isinstance(hwid, basestring):
             self.hwid = int(hwid, 16)
         else:
             self.hwid = hwid
         self.trans = Translator()
         self.seqnum = SEQNUM_MIN
+        if auth_key is not None:
+            self.auth = AuthSession(auth_key, self.hwid)
+        else:
+            self.auth = None
 
     def _inc_seqnum(self):
         self.seqnum = max((self.seqnum + 1) % SEQNUM_MAX, SEQNUM_MIN)
@@ -79,13 +81,28 @@ class CommandHandler(object):
     def flush(self):
         pass
 
-    def _send_cmd_once(self, cmd, timeout):
+    def _start_auth_session(self, timeout):
+        resp = self._send_cmd_once("lst get_auth_session", timeout)
+        if resp is None or not resp.startswith("lst auth_session "):
+            raise ResponseError(
+                "Could not start an authenticated session: %s" % resp)
+        fields = resp.split()
+        self.auth.start(int(fields[2]), int(fields[3]))
+
+    def _send_cmd_once(self, cmd, timeout, secure=False):
+        if secure:
+            if self.auth is None:
+                raise ValueError("secure commands need an auth key")
+            if self.auth.session is None:
+                self._start_auth_session(timeout)
         t = time.time()
         if timeout is not None:
             expires = t + timeout
         msg = self.trans.bytes_from_string(
             hwid=self.hwid, seqnum=self.seqnum,
             s=cmd)
+        if secure:
+            msg = self.auth.wrap(msg)
         self.flush()
         self.send_message(msg)
 
@@ -96,25 +113,38 @@ class CommandHandler(object):
                 poll_timeout = max(expires - time.time(), 0.)
             reply_msg = self.poll_message(timeout=poll_timeout)
             if reply_msg and self._is_reply(msg, reply_msg):
-                return self.trans.string_from_bytes(reply_msg)
+                if secure:
+                    try:
+                        reply_msg = self.auth.unwrap(reply_msg)
+                    except AuthError as e:
+                        log.warning("Dropping reply: %s", e)
+                        continue
+                resp = self.trans.string_from_bytes(reply_msg)
+                if secure and resp == "lst nack":
+                    # Most likely the radio has rebooted and started
+                    # a new session, or another process has used up
+                    # our counters. Either way, fetch the session and
+                    # its last counter again.
+                    self.auth.session = None
+                return resp
         return None
 
-    def send_cmd_once(self, cmd, timeout):
+    def send_cmd_once(self, cmd, timeout, secure=False):
         self._inc_seqnum()
         log.debug("Sending (%04X): %s", self.hwid, cmd)
-        resp = self._send_cmd_once(cmd, timeout)
+        resp = self._send_cmd_once(cmd, timeout, secure=secure)
         if resp:
             log.debug("Response: %s", resp)
         else:
             log.debug("No response")
         return resp
 
-    def send_cmd(self, cmd, timeout=1.2, retries=None):
+    def send_cmd(self, cmd, timeout=1.2, retries=None, secure=False):
         tries = 0
         log.debug("Sending (%04X): %s", self.hwid, cmd)
         self._inc_seqnum()
         while retries is None or tries <= retries:
-            resp = self._send_cmd_once(cmd, timeout=timeout)
+            resp = self._send_cmd_once(cmd, timeout=timeout, secure=secure)
             if resp:
                 log.debug("Response: %s", resp)
                 return resp
@@ -134,26 +164,6 @@ class CommandHandler(object):
             return resp
 
 
-def esp_parser():
-    buf = bytearray()
-    while True:
-        # see if there's an ESP header
-        while ESP_HEADER not in buf:
-            buf += yield
-        packet = buf.split(ESP_HEADER, 1)[1]
-        while len(packet) < 1:
-            packet += yield
-        length = packet[0]
-        if len(packet) > 1:
-            data = packet[1:]
-        else:
-            data = bytearray()
-        while len(data) < length:
-            data += yield
-        data += yield data[:length]
-        buf = data[length:]
-
-
 _serial_connections = {}
 
 
@@ -173,8 +183,10 @@ class SerialListener(Thread):
     def update(self):
         with self.serial_lock:
             msg = self.parser.send(self.serial.read(4096))
-        if msg:
-            self.messages.put(msg)
+            # A v2 frame can hold several messages
+            while msg:
+                self.messages.put(msg)
+                msg = self.parser.send('')
 
     def run(self):
         while True:
@@ -187,21 +199,21 @@ class SerialListener(Thread):
 
 
 class SerialCommandHandler(CommandHandler):
-    def __init__(self, hwid, rx_socket, baud=115200, **kw):
+    def __init__(self, hwid, rx_socket, baud=115200, auth_key=None,
+                 esp2=False, **kw):
         global _serial_connections
-        super(SerialCommandHandler, self).__init__(hwid)
+        super(SerialCommandHandler, self).__init__(hwid, auth_key)
+        self.esp2 = esp2
         if rx_socket not in _serial_connections:
             _serial_connections[rx_socket] = SerialListener(rx_socket, baud)
             _serial_connections[rx_socket].start()
         self.listener = _serial_connections[rx_socket]
 
     def send_message(self, msg):
-        outbuf = bytearray()
-        outbuf += ESP_START_BYTE_0
-        outbuf += ESP_START_BYTE_1
-        outbuf += chr(len(msg))
-        outbuf += msg
-        self.listener.write(outbuf)
+        if self.esp2:
+            self.listener.write(esp2_frame([msg]))
+        else:
+            self.listener.write(esp_frame(msg))
 
     def flush(self):
         self.listener.update()
@@ -216,9 +228,9 @@ class SerialCommandHandler(CommandHandler):
 
 
 class ZMQCommandHandler(CommandHandler):
-    def __init__(self, hwid, rx_socket, tx_socket, **kw):
+    def __init__(self, hwid, rx_socket, tx_socket, auth_key=None, **kw):
         import zmq
-        super(ZMQCommandHandler, self).__init__(hwid)
+        super(ZMQCommandHandler, self).__init__(hwid, auth_key)
         self.context = zmq.Context()
 
         self.rx = self.context.socket(zmq.SUB)
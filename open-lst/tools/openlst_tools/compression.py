@@ -0,0 +1,144 @@
+# OpenLST
+# Copyright (C) 2018 Planet Labs Inc.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+"""LZSS codec matching the firmware's per-frame payload compression.
+
+Compressed frames are sent over RF with the compressed flag set and are
+forwarded to the serial port with ESP_START_BYTE_1_LZ in place of the
+normal second start byte. The first COMPRESSED_HEADER_SIZE bytes of the
+message (HWID, seqnum and system) are left uncompressed.
+
+The compressed form is the uncompressed length followed by a bitstream
+of tokens (MSB first):
+
+  1 + 8 bits                      literal byte
+  0 + OFFSET_BITS + LENGTH_BITS   copy (length + MIN_MATCH) bytes from
+                                  (offset + 1) bytes back
+"""
+
+OFFSET_BITS = 6
+LENGTH_BITS = 4
+WINDOW = 1 << OFFSET_BITS
+MIN_MATCH = 2
+MAX_MATCH = MIN_MATCH + (1 << LENGTH_BITS) - 1
+
+COMPRESSED_HEADER_SIZE = 5
+
+
+class DecompressionError(Exception):
+    pass
+
+
+class _BitWriter(object):
+    def __init__(self):
+        self.out = bytearray()
+        self.bit = 0
+
+    def put(self, value, count):
+        for shift in range(count - 1, -1, -1):
+            if self.bit == 0:
+                self.out.append(0)
+                self.bit = 0x80
+            if value & (1 << shift):
+                self.out[-1] |= self.bit
+            self.bit >>= 1
+
+
+class _BitReader(object):
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+        self.bit = 0x80
+
+    def get(self, count):
+        value = 0
+        for _ in range(count):
+            if self.pos >= len(self.data):
+                raise DecompressionError("truncated bitstream")
+            value <<= 1
+            if self.data[self.pos] & self.bit:
+                value |= 1
+            self.bit >>= 1
+            if self.bit == 0:
+                self.bit = 0x80
+                self.pos += 1
+        return value
+
+
+def compress(data):
+    """Compress data the same way the firmware does (greedy, nearest
+    longest match)."""
+    data = bytearray(data)
+    if len(data) > 255:
+        raise ValueError("frames are at most 255 bytes")
+    writer = _BitWriter()
+    i = 0
+    while i < len(data):
+        best_len = 0
+        best_offset = 0
+        max_len = min(len(data) - i, MAX_MATCH)
+        for j in range(i - 1, max(i - WINDOW, 0) - 1, -1):
+            k = 0
+            while k < max_len and data[j + k] == data[i + k]:
+                k += 1
+            if k > best_len:
+                best_len = k
+                best_offset = i - j
+                if k == max_len:
+                    break
+        if best_len >= MIN_MATCH:
+            writer.put(((best_offset - 1) << LENGTH_BITS) |
+                       (best_len - MIN_MATCH),
+                       1 + OFFSET_BITS + LENGTH_BITS)
+            i += best_len
+        else:
+            writer.put(0x100 | data[i], 9)
+            i += 1
+    return bytearray([len(data)]) + writer.out
+
+
+def decompress(data):
+    data = bytearray(data)
+    if not data:
+        raise DecompressionError("empty frame")
+    length = data[0]
+    reader = _BitReader(data[1:])
+    out = bytearray()
+    while len(out) < length:
+        if reader.get(1):
+            out.append(reader.get(8))
+        else:
+            offset = reader.get(OFFSET_BITS) + 1
+            count = reader.get(LENGTH_BITS) + MIN_MATCH
+            if offset > len(out) or len(out) + count > length:
+                raise DecompressionError("invalid back reference")
+            for _ in range(count):
+                out.append(out[-offset])
+    return out
+
+
+def compress_message(msg):
+    """Compress a command message, leaving the header uncompressed"""
+    msg = bytearray(msg)
+    return (msg[:COMPRESSED_HEADER_SIZE] +
+            compress(msg[COMPRESSED_HEADER_SIZE:]))
+
+
+def decompress_message(msg):
+    """Expand a message that was forwarded with the compressed flag"""
+    msg = bytearray(msg)
+    return (msg[:COMPRESSED_HEADER_SIZE] +
+            decompress(msg[COMPRESSED_HEADER_SIZE:]))
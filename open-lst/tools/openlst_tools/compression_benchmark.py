@@ -0,0 +1,128 @@
+# OpenLST
+# Copyright (C) 2018 Planet Labs Inc.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+"""Benchmark payload compression on recorded traffic.
+
+The input is either a raw capture of the ESP-framed serial stream a
+payload sends to UART1 (the default) or a text file with one hex encoded
+message per line (--hex). Each message is compressed the way the
+firmware would compress it before forwarding it over RF, and the
+compression ratio, the resulting RF throughput and the speed of the
+host-side codec are reported.
+"""
+
+import argparse
+import time
+from binascii import unhexlify
+from .commands import esp_parser
+from .compression import compress_message, decompress_message, \
+    COMPRESSED_HEADER_SIZE
+
+LST_SYSTEM = 0x01
+
+# Bytes added to each message over RF: length, flags and CRC
+RF_FRAME_OVERHEAD = 4
+
+
+def read_hex(f):
+    for line in f:
+        line = line.strip().replace(' ', '')
+        if line and not line.startswith('#'):
+            yield bytearray(unhexlify(line))
+
+
+def read_esp(f):
+    parser = esp_parser()
+    parser.next()
+    # Feed the parser a byte at a time so every message in the
+    # capture is returned
+    for b in bytearray(f.read()):
+        msg = parser.send(bytearray([b]))
+        if msg:
+            yield msg
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('capture', type=argparse.FileType('rb'),
+                        help="Recorded traffic")
+    parser.add_argument('--hex', action='store_true',
+                        help="The capture has one hex encoded message per "
+                             "line rather than raw serial data")
+    parser.add_argument('--bitrate', type=float, default=3707.,
+                        help="RF data rate in bits per second (after FEC) "
+                             "used to estimate throughput")
+    parser.add_argument('--preamble', type=int, default=8,
+                        help="Preamble and sync word bytes per RF frame")
+    args = parser.parse_args()
+
+    if args.hex:
+        messages = list(read_hex(args.capture))
+    else:
+        messages = list(read_esp(args.capture))
+    # Only payload traffic is compressed by the firmware
+    messages = [m for m in messages
+                if len(m) > COMPRESSED_HEADER_SIZE and
+                m[COMPRESSED_HEADER_SIZE - 1] != LST_SYSTEM]
+    if not messages:
+        print "No payload messages found"
+        return 1
+
+    raw_bytes = 0
+    sent_bytes = 0
+    compressed_count = 0
+    compressed = []
+    t0 = time.time()
+    for msg in messages:
+        c = compress_message(msg)
+        compressed.append(c)
+    t_compress = time.time() - t0
+    t0 = time.time()
+    for c in compressed:
+        decompress_message(c)
+    t_decompress = time.time() - t0
+
+    for msg, c in zip(messages, compressed):
+        raw_bytes += len(msg)
+        # The firmware only sends the compressed form if it is smaller
+        if len(c) < len(msg):
+            sent_bytes += len(c)
+            compressed_count += 1
+        else:
+            sent_bytes += len(msg)
+
+    frame_overhead = len(messages) * (RF_FRAME_OVERHEAD + args.preamble)
+    raw_air = raw_bytes + frame_overhead
+    sent_air = sent_bytes + frame_overhead
+    raw_time = raw_air * 8 / args.bitrate
+    sent_time = sent_air * 8 / args.bitrate
+
+    print "Messages:            %d (%d compressed)" % (
+        len(messages), compressed_count)
+    print "Message bytes:       %d -> %d (ratio %.3f)" % (
+        raw_bytes, sent_bytes, float(sent_bytes) / raw_bytes)
+    print "Air bytes:           %d -> %d (ratio %.3f)" % (
+        raw_air, sent_air, float(sent_air) / raw_air)
+    print "Payload throughput:  %.0f -> %.0f bytes/s at %.0f bit/s" % (
+        raw_bytes / raw_time, raw_bytes / sent_time, args.bitrate)
+    print "Host compress:       %.0f bytes/s" % (
+        raw_bytes / max(t_compress, 1e-9))
+    print "Host decompress:     %.0f bytes/s" % (
+        raw_bytes / max(t_decompress, 1e-9))
+
+
+if __name__ == '__main__':
+    main()
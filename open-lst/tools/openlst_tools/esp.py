@@ -0,0 +1,184 @@
+# OpenLST
+# Copyright (C) 2018 Planet Labs Inc.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+"""ESP serial framing.
+
+v1 frames carry one message with no integrity check:
+
+  0x22 0x69 len msg
+
+Compressed messages forwarded from RF use 0x6a as the second start byte.
+
+v2 frames carry one or more messages and a CRC:
+
+  0x22 0x6b len ~len flags [msg_len msg]... crc_lo crc_hi
+
+len counts the flags and the messages, and the CRC covers the same
+bytes. It is the CC1110's hardware CRC16 (polynomial 0x8005, initial
+value 0xffff), as used by the firmware's crc16(). A UART starts replying
+with v2 frames once it has been sent one.
+"""
+
+import logging
+import struct
+from .compression import decompress_message, DecompressionError
+
+ESP_START_BYTE_0 = '\x22'
+ESP_START_BYTE_1 = '\x69'
+ESP_START_BYTE_1_LZ = '\x6a'
+ESP_START_BYTE_1_V2 = '\x6b'
+ESP_HEADER = ESP_START_BYTE_0 + ESP_START_BYTE_1
+ESP_HEADER_LZ = ESP_START_BYTE_0 + ESP_START_BYTE_1_LZ
+ESP_HEADER_V2 = ESP_START_BYTE_0 + ESP_START_BYTE_1_V2
+
+ESP_MAX_PAYLOAD = 251
+ESP2_CRC_SIZE = 2
+ESP2_MAX_FRAME = ESP_MAX_PAYLOAD - ESP2_CRC_SIZE
+# A message on its own in a v2 frame also needs the flags and its length
+ESP2_MAX_MESSAGE = ESP2_MAX_FRAME - 2
+ESP2_FLAG_LZ = 0x01
+
+log = logging.getLogger(__name__)
+
+
+def crc16(data):
+    crc = 0xffff
+    for b in bytearray(data):
+        crc ^= b << 8
+        for _ in range(8):
+            if crc & 0x8000:
+                crc = ((crc << 1) ^ 0x8005) & 0xffff
+            else:
+                crc = (crc << 1) & 0xffff
+    return crc
+
+
+def esp_frame(msg):
+    """Frame a single message with v1 framing"""
+    return ESP_HEADER + chr(len(msg)) + str(msg)
+
+
+def esp2_frame(msgs, flags=0):
+    """Pack a list of messages into a single v2 frame"""
+    body = chr(flags) + ''.join(chr(len(m)) + str(m) for m in msgs)
+    if len(body) > ESP2_MAX_FRAME:
+        raise ValueError("Messages are too long for one frame")
+    return (ESP_HEADER_V2 + chr(len(body)) + chr(~len(body) & 0xff) +
+            body + struct.pack('<H', crc16(body)))
+
+
+def esp2_batches(msgs):
+    """Group messages into lists that each fit in a v2 frame"""
+    batch = []
+    size = 1
+    for msg in msgs:
+        if batch and size + 1 + len(msg) > ESP2_MAX_FRAME:
+            yield batch
+            batch = []
+            size = 1
+        batch.append(msg)
+        size += 1 + len(msg)
+    if batch:
+        yield batch
+
+
+def _find_esp_header(buf):
+    """Return (index, second start byte) of the first ESP header in buf"""
+    found = [(buf.find(h), h[1]) for h in
+             (ESP_HEADER, ESP_HEADER_LZ, ESP_HEADER_V2)]
+    found = [f for f in found if f[0] >= 0]
+    if not found:
+        return -1, None
+    return min(found)
+
+
+def _unpack_v2(body):
+    """Split the body of a v2 frame into its messages"""
+    flags = body[0]
+    msgs = []
+    offset = 1
+    while offset < len(body):
+        length = body[offset]
+        msg = body[offset + 1:offset + 1 + length]
+        if length == 0 or len(msg) != length:
+            log.warning("Dropping malformed v2 frame")
+            return []
+        msgs.append(msg)
+        offset += 1 + length
+    if flags & ESP2_FLAG_LZ:
+        msgs = [m for m in (_decompress(m) for m in msgs) if m is not None]
+    return msgs
+
+
+def _decompress(msg):
+    try:
+        return decompress_message(msg)
+    except DecompressionError as e:
+        log.warning("Dropping compressed message: %s", e)
+        return None
+
+
+def esp_parser():
+    """Generator that parses v1 and v2 ESP frames
+
+    Send it the bytes as they are received. Each send returns the next
+    complete message or None. Send an empty string to collect any more
+    messages that are already buffered.
+    """
+    buf = bytearray()
+    while True:
+        # see if there's an ESP header
+        start, kind = _find_esp_header(buf)
+        while start < 0:
+            buf += yield
+            start, kind = _find_esp_header(buf)
+        packet = buf[start + len(ESP_HEADER):]
+        if kind == ESP_START_BYTE_1_V2:
+            while len(packet) < 2:
+                packet += yield
+            length = packet[0]
+            if packet[1] != (~length & 0xff) or length < 2 or \
+                    length > ESP2_MAX_FRAME:
+                # Bad length, look for the next header right away
+                buf = packet
+                continue
+            while len(packet) < 2 + length + ESP2_CRC_SIZE:
+                packet += yield
+            body = packet[2:2 + length]
+            crc, = struct.unpack('<H', bytes(
+                packet[2 + length:2 + length + ESP2_CRC_SIZE]))
+            if crc16(body) != crc:
+                log.warning("Dropping v2 frame with a bad CRC")
+                buf = packet
+                continue
+            buf = packet[2 + length + ESP2_CRC_SIZE:]
+            for msg in _unpack_v2(body):
+                buf += yield msg
+            continue
+        while len(packet) < 1:
+            packet += yield
+        length = packet[0]
+        if len(packet) > 1:
+            data = packet[1:]
+        else:
+            data = bytearray()
+        while len(data) < length:
+            data += yield
+        msg = data[:length]
+        if kind == ESP_START_BYTE_1_LZ:
+            msg = _decompress(msg)
+        data += yield msg
+        buf = data[length:]
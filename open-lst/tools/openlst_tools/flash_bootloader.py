@@ -25,7 +25,7 @@ from .arguments import hwid_type, aes_key_option
 from .flash_constants import (
     FLASH_SIGNATURE_KEYS, FLASH_RESERVED, FLASH_HWID, FLASH_APP_START,
     FLASH_BOOTLOADER_STORAGE, FLASH_APP_END, FLASH_APP_SIGNATURE,
-    FLASH_STORAGE_START, FLASH_UPDATER_START)
+    FLASH_STORAGE_START, FLASH_UPDATER_START, FLASH_AUTH_KEY)
 
 LOCK_BITS = "{:02X}".format(
     0b000 << 5 |  # Write to 0 per datasheet (not used)
@@ -94,6 +94,10 @@ def insert_storage(image, storage=None):
     image[FLASH_STORAGE_START:FLASH_UPDATER_START] = storage
 
 
+def insert_auth_key(image, key):
+    image[FLASH_AUTH_KEY:FLASH_AUTH_KEY + len(key)] = key
+
+
 def main():
     parser = argparse.ArgumentParser()
     key_source = parser.add_mutually_exclusive_group(required=True)
@@ -113,6 +117,11 @@ def main():
         default=0,
         help="A uint16 (in hex) for the reserved bytes in the "
         "bootloader storage. Default is 0.")
+    parser.add_argument(
+        '--auth-key',
+        type=aes_key_option,
+        help="AES key for authenticated commands (in hex format). "
+        "Only used by firmware built with AUTH_ENABLED")
     parser.add_argument(
         '-i', '--hwid',
         required=True,
@@ -139,6 +148,8 @@ def main():
     insert_application(bootloader)
     insert_signature(bootloader)
     insert_storage(bootloader)
+    if args.auth_key:
+        insert_auth_key(bootloader, args.auth_key)
     with tempfile.NamedTemporaryFile(delete=False, suffix='.hex') as tf:
         tf.write(dump_hex_file(bootloader))
     cmd = [
@@ -28,3 +28,4 @@ FLASH_APP_SIGNATURE = 0x6BF0
 FLASH_UPDATER_START = 0x7000
 FLASH_STORAGE_START = 0x6C00
 FLASH_STORAGE_END = 0x6FFF
+FLASH_AUTH_KEY = 0x6FF0
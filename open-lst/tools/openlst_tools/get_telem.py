@@ -15,11 +15,14 @@
 # along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 import os
+import time
 import argparse
 import logging
 from .commands import get_handler
 from .arguments import hwid_type
 from .radio_mux import UART1_RX_SOCKET, UART1_TX_SOCKET
+from .translator import BATCH_SEPARATOR, TELEM_SEL_DELTA_KEY
+from .translator import TELEM_SEL_ALL_KEY
 
 TELEM_FIELDS = (
     "reserved",
@@ -47,12 +50,110 @@ TELEM_FIELDS = (
     "packets_rejected_checksum",
     "packets_rejected_reserved",
     "packets_rejected_other",
-    "reserved0",
-    "reserved1",
+    "stack_free",
+    "xram_free",
     "custom0",
     "custom1",
+    "packets_rs_corrected",
+    "rs_symbols_corrected",
+    "uart0_rx_dropped",
+    "uart1_rx_dropped",
+    "uart0_rts_stall_ms",
+    "uart1_rts_stall_ms",
+    "reply_cache_hits",
+    "schedule_starved",
+    "uart0_starved",
+    "uart1_starved",
+    "rf_starved",
+    "timetag_queued",
+    "adc_min0",
+    "adc_min1",
+    "adc_min2",
+    "adc_min3",
+    "adc_min4",
+    "adc_min5",
+    "adc_min6",
+    "adc_min7",
+    "adc_min8",
+    "adc_min9",
+    "adc_max0",
+    "adc_max1",
+    "adc_max2",
+    "adc_max3",
+    "adc_max4",
+    "adc_max5",
+    "adc_max6",
+    "adc_max7",
+    "adc_max8",
+    "adc_max9",
 )
 
+HISTORY_FIELDS = (
+    "uptime",
+    "adc0",
+    "adc1",
+    "adc2",
+    "adc3",
+    "adc4",
+    "adc5",
+    "adc6",
+    "adc7",
+    "adc8",
+    "adc9",
+    "last_rssi",
+    "packets_sent",
+    "packets_good",
+    "packets_rejected_checksum",
+)
+
+
+def get_history(con, start):
+    """Page through the telemetry history from the given uptime"""
+    while True:
+        resp = con.send_cmd("lst get_telem_history %d" % start)
+        if resp is None or not resp.startswith("lst telem_history"):
+            print resp
+            return
+        records = resp.split(None, 2)[2:]
+        if not records:
+            return
+        for record in records[0].split(BATCH_SEPARATOR):
+            values = record.split()
+            print ' '.join(
+                "%s=%s" % (field, val)
+                for field, val in zip(HISTORY_FIELDS, values))
+        start = int(values[0]) + 1
+
+
+def watch(con, fields, interval):
+    """Poll the selected fields, asking for changes since each reply"""
+    if TELEM_SEL_ALL_KEY in fields:
+        fields = TELEM_FIELDS
+    values = {}
+    ack = None
+    while True:
+        cmd = "lst get_telem_sel "
+        if ack is not None:
+            cmd += "%s %d " % (TELEM_SEL_DELTA_KEY, ack)
+        resp = con.send_cmd(cmd + ' '.join(fields))
+        if resp is None or not resp.startswith("lst telem_sel"):
+            # Without a reply there is nothing to take deltas against
+            print resp
+            ack = None
+        else:
+            tokens = resp.split()[2:]
+            ack = int(tokens[0]) or None
+            delta = len(tokens) > 1 and tokens[1] == TELEM_SEL_DELTA_KEY
+            for token in tokens[2 if delta else 1:]:
+                field, val = token.split('=')
+                if delta:
+                    values[field] += int(val)
+                else:
+                    values[field] = int(val)
+            print ' '.join("%s=%d" % (field, values[field])
+                           for field in fields)
+        time.sleep(interval)
+
 
 def main():
     parser = argparse.ArgumentParser()
@@ -70,6 +171,21 @@ def main():
         '-i', '--hwid',
         type=hwid_type,
         help="The HWID of the satellite or ground radio")
+    parser.add_argument(
+        '--history',
+        type=int,
+        metavar='UPTIME',
+        help="Download the stored history from this uptime instead")
+    parser.add_argument(
+        '--select',
+        type=lambda s: s.split(','),
+        metavar='FIELD[,FIELD...]',
+        help="Poll just these fields, with deltas where the radio has them")
+    parser.add_argument(
+        '--interval',
+        type=float,
+        default=1.0,
+        help="Seconds between polls with --select")
 
     args = parser.parse_args()
 
@@ -78,6 +194,12 @@ def main():
     log.setLevel(logging.DEBUG)
 
     con = get_handler(args.hwid, args.rx_path, args.tx_path)
+    if args.history is not None:
+        get_history(con, args.history)
+        return
+    if args.select:
+        watch(con, args.select, args.interval)
+        return
     resp = con.send_cmd("lst get_telem")
     print resp
     for field, val in zip(TELEM_FIELDS, resp.split()[2:]):
@@ -18,7 +18,7 @@ import os
 import argparse
 import logging
 from .commands import get_handler
-from .arguments import hwid_type
+from .arguments import hwid_type, aes_key_option
 from .radio_mux import UART1_RX_SOCKET, UART1_TX_SOCKET
 
 
@@ -38,6 +38,13 @@ def main():
         '-i', '--hwid',
         type=hwid_type,
         help="The HWID of the satellite or ground radio")
+    parser.add_argument(
+        '--auth-key',
+        type=aes_key_option,
+        default=os.environ.get('AUTH_KEY'),
+        help="Send the command as an authenticated command using this AES-128 "
+        "key (as a hex string). This can also be specified via the "
+        "AUTH_KEY environment variable")
     parser.add_argument("command")
 
     args = parser.parse_args()
@@ -46,8 +53,9 @@ def main():
     log = logging.getLogger()
     log.setLevel(logging.DEBUG)
 
-    con = get_handler(args.hwid, args.rx_path, args.tx_path)
-    resp = con.send_cmd(args.command)
+    con = get_handler(args.hwid, args.rx_path, args.tx_path,
+                      auth_key=args.auth_key)
+    resp = con.send_cmd(args.command, secure=args.auth_key is not None)
     print resp
 
 if __name__ == '__main__':
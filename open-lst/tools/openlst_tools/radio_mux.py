@@ -24,10 +24,9 @@ import signal
 import zmq
 from binascii import hexlify
 from threading import Thread, Event, Lock
-from Queue import Queue
-
-ESP_START_BYTE_0 = '\x22'
-ESP_START_BYTE_1 = '\x69'
+from Queue import Queue, Empty
+from .esp import esp_parser, esp_frame, esp2_frame, esp2_batches, \
+    ESP2_MAX_MESSAGE
 
 DEFAULT_RX_SOCKET = 'ipc:///tmp/radiomux_rx'
 DEFAULT_TX_SOCKET = 'ipc:///tmp/radiomux_tx'
@@ -49,7 +48,14 @@ def get_parser():
                         default=DEFAULT_RX_SOCKET)
     parser.add_argument('--echo-socket',
                         default=DEFAULT_ECHO_SOCKET)
-    parser.add_argument('--baud', default=115200)
+    parser.add_argument('--baud', type=int, default=115200,
+                        help="The serial baud rate (must match "
+                        "CONFIG_UART1_BAUD_RATE on the radio)")
+    parser.add_argument('--rtscts', action='store_true',
+                        help="Use RTS/CTS hardware flow control")
+    parser.add_argument('--esp2', action='store_true',
+                        help="Send v2 ESP frames (with a CRC), batching "
+                        "queued messages together")
     parser.add_argument('--user')
     parser.add_argument('--group')
     parser.add_argument('--mode')
@@ -58,13 +64,13 @@ def get_parser():
 
 class ZMQPoller(Thread):
     def __init__(self, tx_socket, rx_socket, echo_socket, serial_port,
-                 user=None, group=None, mode=None):
+                 user=None, group=None, mode=None, esp2=False):
         self.stop = Event()
         self.tx_socket = tx_socket
         self.rx_socket = rx_socket
         self.echo_socket = echo_socket
         self.serial_port = serial_port
-        self.serial_tx = SerialTx(serial_port, self)
+        self.serial_tx = SerialTx(serial_port, self, esp2)
         self.serial_rx = SerialRx(serial_port, self)
         self.rx_ready = Event()
         self.rx_lock = Lock()
@@ -126,20 +132,42 @@ class ZMQPoller(Thread):
 class SerialTx(Thread):
     daemon = True
 
-    def __init__(self, serial_port, zmq_poller):
+    def __init__(self, serial_port, zmq_poller, esp2=False):
         self.serial_port = serial_port
         self.zmq_poller = zmq_poller
+        self.esp2 = esp2
         self.queue = Queue()
         super(SerialTx, self).__init__()
 
+    def get_messages(self):
+        """Wait for a message and collect any others already queued"""
+        msgs = [self.queue.get()[:250]]
+        while self.esp2:
+            try:
+                msgs.append(self.queue.get_nowait()[:250])
+            except Empty:
+                break
+        return msgs
+
     def run(self):
         log.debug("Waiting for serial messages to transmit")
         while True:
-            msg = self.queue.get()[:250]
-            log.debug("Sending serial message %s",
-                      ''.join(hex(ord(b)) for b in msg))
-            header = ESP_START_BYTE_0 + ESP_START_BYTE_1 + chr(len(msg))
-            self.serial_port.write(header + msg)
+            msgs = self.get_messages()
+            for msg in msgs:
+                log.debug("Sending serial message %s",
+                          ''.join(hex(ord(b)) for b in msg))
+            if not self.esp2:
+                self.serial_port.write(esp_frame(msgs[0]))
+                continue
+            # Messages too long to share a v2 frame go on their own
+            # in a v1 frame
+            long_msgs = [m for m in msgs if len(m) > ESP2_MAX_MESSAGE]
+            msgs = [m for m in msgs if len(m) <= ESP2_MAX_MESSAGE]
+            for msg in long_msgs:
+                self.serial_port.write(esp_frame(msg))
+            for batch in esp2_batches(msgs):
+                log.debug("Sending %d messages in one frame", len(batch))
+                self.serial_port.write(esp2_frame(batch))
 
 
 class SerialRx(Thread):
@@ -152,22 +180,17 @@ class SerialRx(Thread):
         super(SerialRx, self).__init__()
 
     def read_messages(self):
+        parser = esp_parser()
+        parser.next()
         while True:
-            # wait for ESP sync
-            b = ""
-            log.debug("Waiting for start byte 1")
-            while b != ESP_START_BYTE_0:
-                b = self.serial_port.read(1)
-            log.debug("Waiting for start byte 2")
-            while b == ESP_START_BYTE_0:
-                b = self.serial_port.read(1)
-            if b != ESP_START_BYTE_1:
-                continue
-            length = ord(self.serial_port.read(1))
-            log.debug("Length is %d", length)
-            packet = self.serial_port.read(length)
-            log.debug("Got message")
-            yield packet
+            # Block for the first byte then take whatever else is there
+            data = self.serial_port.read(1)
+            data += self.serial_port.read(self.serial_port.inWaiting())
+            msg = parser.send(data)
+            while msg:
+                log.debug("Got message")
+                yield str(msg)
+                msg = parser.send('')
 
     def run(self):
         log.debug("Listening for serial messages")
@@ -185,7 +208,7 @@ def main():
     serial_port = serial.Serial(
         port=args.stty,
         baudrate=args.baud,
-        rtscts=False,
+        rtscts=args.rtscts,
         parity=serial.PARITY_NONE,
         stopbits=serial.STOPBITS_ONE)
     print serial_port
@@ -196,7 +219,8 @@ def main():
         serial_port=serial_port,
         user=args.user,
         group=args.group,
-        mode=None if args.mode is None else int(args.mode, 8))
+        mode=None if args.mode is None else int(args.mode, 8),
+        esp2=args.esp2)
 
     signal.signal(signal.SIGTERM, zmq_poller.stop_now)
     signal.signal(signal.SIGINT, zmq_poller.stop_now)
@@ -20,6 +20,8 @@ import zmq
 from blessed import Terminal
 from .translator import Translator
 from .translator import CMD_TREE
+from .translator import BATCH_COMMAND_KEY, BATCH_SEPARATOR
+from .translator import TIMETAG_ADD_COMMAND_KEY
 import sys
 import threading
 import readline
@@ -157,6 +159,15 @@ class RadioTerminal(object):
     def tab_completer(self, text, index):
         self.user_buffer = readline.get_line_buffer()
         cmd_parts = self.user_buffer.split(' ')
+        # Inside a batch, complete the command after the last separator
+        if len(cmd_parts) > 2 and cmd_parts[1] == BATCH_COMMAND_KEY:
+            rest = self.user_buffer.split(BATCH_COMMAND_KEY, 1)[1]
+            cmd_parts = (
+                [cmd_parts[0]] +
+                rest.split(BATCH_SEPARATOR)[-1].lstrip().split(' '))
+        # After the time in a timetag_add, complete the queued command
+        elif len(cmd_parts) > 4 and cmd_parts[1] == TIMETAG_ADD_COMMAND_KEY:
+            cmd_parts = [cmd_parts[0]] + cmd_parts[4:]
         options = _navigate_tree(cmd_parts, CMD_TREE)
         _pretty_list_print(options)
         self.print_user_buffer()
@@ -19,7 +19,7 @@ import argparse
 import logging
 from datetime import datetime
 from .commands import get_handler
-from .arguments import hwid_type
+from .arguments import hwid_type, aes_key_option
 from .radio_mux import UART1_RX_SOCKET, UART1_TX_SOCKET
 
 J2000 = datetime(2000, 1, 1, 11, 58, 55, 816000)
@@ -41,6 +41,13 @@ def main():
         '-i', '--hwid',
         type=hwid_type,
         help="The HWID of the satellite or ground radio")
+    parser.add_argument(
+        '--auth-key',
+        type=aes_key_option,
+        default=os.environ.get('AUTH_KEY'),
+        help="Send set_time as an authenticated command using this AES-128 "
+        "key (as a hex string). This can also be specified via the "
+        "AUTH_KEY environment variable")
 
     args = parser.parse_args()
 
@@ -48,7 +55,8 @@ def main():
     log = logging.getLogger()
     log.setLevel(logging.DEBUG)
 
-    con = get_handler(args.hwid, args.rx_path, args.tx_path)
+    con = get_handler(args.hwid, args.rx_path, args.tx_path,
+                      auth_key=args.auth_key)
     resp = None
     while not resp:
         dt = datetime.utcnow() - J2000
@@ -56,7 +64,8 @@ def main():
             "lst set_time {seconds:d} {nanoseconds:d}".format(
                 seconds=int(dt.total_seconds()),
                 nanoseconds=dt.microseconds * 1000),
-            timeout=0.5
+            timeout=0.5,
+            secure=args.auth_key is not None
         )
     print resp
 
@@ -34,6 +34,34 @@ GET_TELEM = '\x17'
 TELEM = '\x18'
 GET_TIME = '\x13'
 SET_TIME = '\x14'
+SECURE = '\x1c'
+GET_AUTH_SESSION = '\x1d'
+AUTH_SESSION = '\x1e'
+BATCH = '\x1f'
+BATCH_REPLY = '\x20'
+GET_PROFILE = '\x21'
+PROFILE = '\x22'
+PROFILE_ISR_SITES = ["rf", "uart0_rx", "uart0_tx", "uart1_rx",
+                     "uart1_tx", "uart1_dma", "adc", "t1"]
+PROFILE_ISR_BUCKETS = 8
+TIMETAG_ADD = '\x23'
+TIMETAG_ID = '\x24'
+TIMETAG_LIST = '\x25'
+TIMETAG_ENTRIES = '\x26'
+TIMETAG_CANCEL = '\x27'
+TIMETAG_ADD_COMMAND_KEY = "timetag_add"
+GET_TELEM_HISTORY = '\x28'
+TELEM_HISTORY = '\x29'
+GET_TELEM_SEL = '\x2a'
+TELEM_SEL = '\x2b'
+TELEM_SEL_DELTA_KEY = "delta"
+TELEM_SEL_ALL_KEY = "all"
+SET_BEACON = '\x2c'
+BEACON = '\x2d'
+BEACON_OUTPUTS = ["rf", "uart0", "uart1"]
+BATCH_SEPARATOR = ';'
+BATCH_COMMAND_KEY = "batch"
+BATCH_REPLY_COMMAND_KEY = "batch_reply"
 BOOTLOADER_PING = '\x00'
 BOOTLOADER_ERASE = '\x0c'
 BOOTLOADER_WRITE_PAGE = '\x02'
@@ -174,6 +202,16 @@ class HexArgument(Argument):
         return hexlify(bstring[:self.length]), bstring[self.length:]
 
 
+class VarHexArgument(Argument):
+    """Hex data that takes up the rest of the message"""
+
+    def to_bytes(self, value):
+        return unhexlify(value.replace(' ', ''))
+
+    def from_bytes(self, bstring):
+        return hexlify(bstring), ""
+
+
 class StringArgument(Argument):
     def __init__(self, name):
         super(StringArgument, self).__init__(name)
@@ -247,6 +285,206 @@ class Command(object):
         return ' '.join(rv)
 
 
+class BatchCommand(Command):
+    """Several commands separated by ';', each sent as [len][opcode data]"""
+
+    def tokens_to_bytes(self, tokens):
+        rv = b""
+        rv += self.opcode
+        for sub in ' '.join(tokens).split(BATCH_SEPARATOR):
+            sub_tokens = sub.split()
+            if not sub_tokens:
+                continue
+            if sub_tokens[0] in (BATCH_COMMAND_KEY, BATCH_REPLY_COMMAND_KEY):
+                raise ValueError("batches can't be nested")
+            msg = CMD_STRING_MAP[sub_tokens[0]].tokens_to_bytes(sub_tokens[1:])
+            rv += pack('<B', len(msg)) + msg
+        return rv
+
+    def bytes_to_string(self, msg):
+        rv = []
+        while msg:
+            sub_len = ord(msg[0])
+            sub, msg = msg[1:1 + sub_len], msg[1 + sub_len:]
+            if len(sub) != sub_len or sub_len == 0:
+                raise ValueError("truncated batch")
+            cmd = CMD_OPCODE_MAP[sub[0]]
+            rv.append((cmd.key + " " + cmd.bytes_to_string(sub[1:])).strip())
+        return (" " + BATCH_SEPARATOR + " ").join(rv)
+
+class TimetagAddCommand(Command):
+    """A time followed by the command to run then, written as usual"""
+
+    def tokens_to_bytes(self, tokens):
+        tokens = list(tokens)
+        n = len(self.args)
+        if len(tokens) <= n:
+            raise Exception("missing argument for command %s" % self.key)
+        if tokens[n] == TIMETAG_ADD_COMMAND_KEY:
+            raise ValueError("time-tagged commands can't be nested")
+        rv = super(TimetagAddCommand, self).tokens_to_bytes(tokens[:n])
+        rv += CMD_STRING_MAP[tokens[n]].tokens_to_bytes(tokens[n + 1:])
+        return rv
+
+    def bytes_to_string(self, msg):
+        rv = []
+        for arg in self.args:
+            k, msg = arg.from_bytes(msg)
+            rv.append(str(k))
+        cmd = CMD_OPCODE_MAP[msg[0]]
+        rv.append((cmd.key + " " + cmd.bytes_to_string(msg[1:])).strip())
+        return ' '.join(rv)
+
+
+class RecordsCommand(Command):
+    """Any number of records of args each, separated by ';'"""
+
+    def format_record(self, fields):
+        return ' '.join(fields)
+
+    def bytes_to_string(self, msg):
+        rv = []
+        while msg:
+            fields = []
+            for arg in self.args:
+                k, msg = arg.from_bytes(msg)
+                fields.append(str(k))
+            rv.append(self.format_record(fields))
+        return (" " + BATCH_SEPARATOR + " ").join(rv)
+
+
+class TimetagEntriesCommand(RecordsCommand):
+    """The queued commands, with the opcode shown by name where known"""
+
+    def format_record(self, fields):
+        opcode = chr(int(fields[-1]))
+        if opcode in CMD_OPCODE_MAP:
+            fields[-1] = CMD_OPCODE_MAP[opcode].key
+        return ' '.join(fields)
+
+def profile_isr_args():
+    """The ISR figures a profile reply ends with when the radio has
+    PROFILE_ISR_ENABLED, in Timer 1 counts"""
+    args = []
+    for site in PROFILE_ISR_SITES:
+        args.append(UInt16Argument("%s_isr_max" % site))
+        args += [UInt16Argument("%s_isr_bucket%d" % (site, i))
+                 for i in range(PROFILE_ISR_BUCKETS)]
+    return args
+
+
+def telem_fields():
+    """The fields of a telem reply, which get_telem_sel numbers from 0"""
+    return CMD_STRING_MAP["telem"].args
+
+
+def zigzag_varint_from_bytes(msg):
+    """Decode one zigzag varint, returning it and the rest of msg"""
+    value = 0
+    shift = 0
+    while True:
+        if not msg:
+            raise ValueError("truncated varint")
+        b = ord(msg[0])
+        msg = msg[1:]
+        value |= (b & 0x7f) << shift
+        shift += 7
+        if not b & 0x80:
+            break
+    return (value >> 1) ^ -(value & 1), msg
+
+
+def telem_mask_from_tokens(tokens):
+    names = [arg.name for arg in telem_fields()]
+    mask = 0
+    for token in tokens:
+        if token == TELEM_SEL_ALL_KEY:
+            mask |= (1 << len(names)) - 1
+        elif token in names:
+            mask |= 1 << names.index(token)
+        else:
+            raise ValueError("unknown telemetry field '%s'" % token)
+    if not mask:
+        raise ValueError("no telemetry fields selected")
+    return pack('<Q', mask)
+
+
+def telem_mask_to_names(msg):
+    mask = unpack('<Q', msg[:8])[0]
+    return [arg.name for i, arg in enumerate(telem_fields())
+            if mask & (1 << i)]
+
+
+class GetTelemSelCommand(Command):
+    """Field names (or "all"), optionally after "delta ID" to ask for
+    only the changes since the telem_sel reply with that ID"""
+
+    def tokens_to_bytes(self, tokens):
+        tokens = list(tokens)
+        ack = b""
+        if tokens and tokens[0] == TELEM_SEL_DELTA_KEY:
+            if len(tokens) < 2:
+                raise Exception("missing argument for command %s" % self.key)
+            ack = UInt8Argument("ack").to_bytes(tokens[1])
+            tokens = tokens[2:]
+        return self.opcode + telem_mask_from_tokens(tokens) + ack
+
+    def bytes_to_string(self, msg):
+        rv = []
+        if len(msg) > 8:
+            rv += [TELEM_SEL_DELTA_KEY, str(ord(msg[8]))]
+        return ' '.join(rv + telem_mask_to_names(msg))
+
+
+class SetBeaconCommand(Command):
+    """Interval in seconds (0 to stop), jitter in ms, outputs joined
+    with commas (rf, uart0, uart1), then field names (or "all")"""
+
+    def tokens_to_bytes(self, tokens):
+        if len(tokens) < 4:
+            raise Exception("missing argument for command %s" % self.key)
+        outputs = 0
+        for name in tokens[2].split(','):
+            if name == "none":
+                continue
+            if name not in BEACON_OUTPUTS:
+                raise ValueError("unknown beacon output '%s'" % name)
+            outputs |= 1 << BEACON_OUTPUTS.index(name)
+        return (self.opcode +
+                UInt16Argument("interval").to_bytes(tokens[0]) +
+                UInt16Argument("jitter").to_bytes(tokens[1]) +
+                chr(outputs) + telem_mask_from_tokens(tokens[3:]))
+
+    def bytes_to_string(self, msg):
+        interval, jitter, outputs = unpack('<HHB', msg[:5])
+        names = [name for i, name in enumerate(BEACON_OUTPUTS)
+                 if outputs & (1 << i)]
+        rv = [str(interval), str(jitter), ','.join(names) or "none"]
+        return ' '.join(rv + telem_mask_to_names(msg[5:]))
+
+
+class TelemSelCommand(Command):
+    """The reply ID, "delta" if the values are changes, then name=value
+    for each field sent"""
+
+    def bytes_to_string(self, msg):
+        reply_id, delta = ord(msg[0]), ord(msg[1])
+        mask = unpack('<Q', msg[2:10])[0]
+        msg = msg[10:]
+        rv = [str(reply_id)]
+        if delta:
+            rv.append(TELEM_SEL_DELTA_KEY)
+        for i, arg in enumerate(telem_fields()):
+            if not mask & (1 << i):
+                continue
+            if delta:
+                value, msg = zigzag_varint_from_bytes(msg)
+                rv.append("%s=%+d" % (arg.name, value))
+            else:
+                value, msg = arg.from_bytes(msg)
+                rv.append("%s=%d" % (arg.name, value))
+        return ' '.join(rv)
+
 COMMANDS = [
     Command("ack", ACK),
     Command("nack", NACK),
@@ -298,11 +536,108 @@ COMMANDS = [
             UInt32Argument("packets_rejected_checksum"),
             UInt32Argument("packets_rejected_reserved"),
             UInt32Argument("packets_rejected_other"),
-            UInt32Argument("reserved0"),
-            UInt32Argument("reserved1"),
+            UInt32Argument("stack_free"),
+            UInt32Argument("xram_free"),
             UInt32Argument("custom0"),
-            UInt32Argument("custom1")),
+            UInt32Argument("custom1"),
+            UInt32Argument("packets_rs_corrected"),
+            UInt32Argument("rs_symbols_corrected"),
+            UInt32Argument("uart0_rx_dropped"),
+            UInt32Argument("uart1_rx_dropped"),
+            UInt32Argument("uart0_rts_stall_ms"),
+            UInt32Argument("uart1_rts_stall_ms"),
+            UInt32Argument("reply_cache_hits"),
+            UInt32Argument("schedule_starved"),
+            UInt32Argument("uart0_starved"),
+            UInt32Argument("uart1_starved"),
+            UInt32Argument("rf_starved"),
+            UInt32Argument("timetag_queued"),
+            Int16Argument("adc_min0"),
+            Int16Argument("adc_min1"),
+            Int16Argument("adc_min2"),
+            Int16Argument("adc_min3"),
+            Int16Argument("adc_min4"),
+            Int16Argument("adc_min5"),
+            Int16Argument("adc_min6"),
+            Int16Argument("adc_min7"),
+            Int16Argument("adc_min8"),
+            Int16Argument("adc_min9"),
+            Int16Argument("adc_max0"),
+            Int16Argument("adc_max1"),
+            Int16Argument("adc_max2"),
+            Int16Argument("adc_max3"),
+            Int16Argument("adc_max4"),
+            Int16Argument("adc_max5"),
+            Int16Argument("adc_max6"),
+            Int16Argument("adc_max7"),
+            Int16Argument("adc_max8"),
+            Int16Argument("adc_max9")),
     Command("ascii", ASCII, StringArgument("text")),
+    Command("get_auth_session", GET_AUTH_SESSION),
+    Command("auth_session", AUTH_SESSION,
+            UInt32Argument("session"),
+            UInt32Argument("last_counter")),
+    Command("secure", SECURE,
+            UInt32Argument("counter"),
+            VarHexArgument("payload")),
+    Command("get_profile", GET_PROFILE),
+    Command("profile", PROFILE,
+            UInt32Argument("schedule_calls"),
+            UInt32Argument("schedule_max"),
+            UInt32Argument("schedule_avg"),
+            UInt32Argument("uart0_calls"),
+            UInt32Argument("uart0_max"),
+            UInt32Argument("uart0_avg"),
+            UInt32Argument("uart1_calls"),
+            UInt32Argument("uart1_max"),
+            UInt32Argument("uart1_avg"),
+            UInt32Argument("rf_calls"),
+            UInt32Argument("rf_max"),
+            UInt32Argument("rf_avg"),
+            UInt32Argument("timers_calls"),
+            UInt32Argument("timers_max"),
+            UInt32Argument("timers_avg"),
+            UInt32Argument("wakeups"),
+            *profile_isr_args(),
+            optional_args=len(PROFILE_ISR_SITES) * (PROFILE_ISR_BUCKETS + 1)),
+    BatchCommand(BATCH_COMMAND_KEY, BATCH),
+    BatchCommand(BATCH_REPLY_COMMAND_KEY, BATCH_REPLY),
+    TimetagAddCommand(TIMETAG_ADD_COMMAND_KEY, TIMETAG_ADD,
+                      UInt32Argument("seconds"),
+                      UInt32Argument("nanoseconds")),
+    Command("timetag_id", TIMETAG_ID,
+            UInt8Argument("id")),
+    Command("timetag_list", TIMETAG_LIST),
+    TimetagEntriesCommand("timetag_entries", TIMETAG_ENTRIES,
+                          UInt8Argument("id"),
+                          UInt32Argument("seconds"),
+                          UInt32Argument("nanoseconds"),
+                          UInt8Argument("command")),
+    Command("timetag_cancel", TIMETAG_CANCEL,
+            UInt8Argument("id")),
+    Command("get_telem_history", GET_TELEM_HISTORY,
+            UInt32Argument("from"),
+            UInt32Argument("to"), optional_args=1),
+    RecordsCommand("telem_history", TELEM_HISTORY,
+                   UInt32Argument("uptime"),
+                   Int16Argument("adc0"),
+                   Int16Argument("adc1"),
+                   Int16Argument("adc2"),
+                   Int16Argument("adc3"),
+                   Int16Argument("adc4"),
+                   Int16Argument("adc5"),
+                   Int16Argument("adc6"),
+                   Int16Argument("adc7"),
+                   Int16Argument("adc8"),
+                   Int16Argument("adc9"),
+                   Int8Argument("last_rssi"),
+                   UInt16Argument("packets_sent"),
+                   UInt16Argument("packets_good"),
+                   UInt16Argument("packets_rejected_checksum")),
+    GetTelemSelCommand("get_telem_sel", GET_TELEM_SEL),
+    TelemSelCommand("telem_sel", TELEM_SEL),
+    SetBeaconCommand("set_beacon", SET_BEACON),
+    TelemSelCommand("beacon", BEACON),
 ]
 
 
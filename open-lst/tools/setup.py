@@ -55,6 +55,8 @@ setup(name='openlst_tools',
               'radio_terminal=openlst_tools.terminal:main',
               'radio_cmd=openlst_tools.radio_cmd:main',
               'radio_time_sync=openlst_tools.time_sync:main',
+              'compression_benchmark='
+              'openlst_tools.compression_benchmark:main',
           ]
       },
       packages=['openlst_tools'],